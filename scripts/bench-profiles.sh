@@ -0,0 +1,207 @@
+#!/bin/sh
+#
+# bench-profiles.sh - compare copy throughput of mount profiles
+#
+# Copyright (C) 2026  wmVolMan contributors
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# Formats an image file on disk and sets it up as a loop device through
+# udisksctl.  For each profile it mounts the loop device with the profile
+# options, copies one large file and a tree of small files onto it, and
+# times the copy up to the point the data is on the image.  Profiles are NAME=OPTIONS arguments, or [profile]
+# groups of the configuration file that match the filesystem type.
+# "defaults" (no options) is always measured first.
+#
+# Needs udisksctl, a running udisksd that allows loop setup and mount
+# for the user, and mkfs for the chosen type.
+
+usage()
+{
+	cat <<USAGE
+Usage: $0 [-t TYPE] [-s MB] [-n FILES] [-d DIR] [-c CONFIG] [NAME=OPTIONS...]
+
+  -t TYPE    filesystem to create: vfat, exfat or ext4 (default vfat)
+  -s MB      size of the large file (default 256)
+  -n FILES   number of 16 kB files in the small file tree (default 2000)
+  -d DIR     directory for the image, on the disk to measure
+             (default \$XDG_CACHE_HOME or ~/.cache)
+  -c CONFIG  read profiles from CONFIG (default ~/.wmvolman/wmvolman.conf)
+USAGE
+	exit 1
+}
+
+die()
+{
+	echo "$0: $*" >&2
+	exit 1
+}
+
+fstype=vfat
+size=256
+files=2000
+config="$HOME/.wmvolman/wmvolman.conf"
+# Not TMPDIR, which is usually tmpfs and would measure memory
+imagedir=${XDG_CACHE_HOME:-$HOME/.cache}
+
+while getopts t:s:n:d:c:h opt; do
+	case $opt in
+	t) fstype=$OPTARG ;;
+	s) size=$OPTARG ;;
+	n) files=$OPTARG ;;
+	d) imagedir=$OPTARG ;;
+	c) config=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+case $fstype in
+vfat)  mkfs="mkfs.vfat" ;;
+exfat) mkfs="mkfs.exfat" ;;
+ext4)  mkfs="mkfs.ext4 -q -F" ;;
+*)     die "unsupported filesystem type $fstype" ;;
+esac
+
+for tool in udisksctl ${mkfs%% *}; do
+	command -v $tool >/dev/null 2>&1 || die "$tool not found"
+done
+
+mkdir -p "$imagedir" || exit 1
+[ "$(stat -f -c %T "$imagedir")" = tmpfs ] &&
+	echo "$0: warning: $imagedir is tmpfs, results will show memory speed" >&2
+
+tmpdir=$(mktemp -d "${TMPDIR:-/tmp}/bench-profiles.XXXXXX") || exit 1
+image=""
+loop=""
+mountpoint=""
+
+cleanup()
+{
+	[ -n "$mountpoint" ] && udisksctl unmount --no-user-interaction -b "$loop" >/dev/null 2>&1
+	[ -n "$loop" ] && udisksctl loop-delete --no-user-interaction -b "$loop" >/dev/null 2>&1
+	[ -n "$image" ] && rm -f "$image"
+	rm -rf "$tmpdir"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# Profiles as NAME=OPTIONS lines
+profiles()
+{
+	echo "defaults="
+	if [ $# -gt 0 ]; then
+		for p in "$@"; do
+			echo "$p"
+		done
+	elif [ -r "$config" ]; then
+		awk -v fstype="$fstype" '
+			function flush() {
+				if (name != "" && match_type)
+					print name "=" options
+				name = ""
+			}
+			/^\[profile [^]]*\]/ {
+				flush()
+				name = substr($0, 10, index($0, "]") - 10)
+				options = ""
+				match_type = 1
+				next
+			}
+			/^\[/ { flush(); next }
+			name != "" && /^options *=/ {
+				sub(/^options *= */, "")
+				options = $0
+			}
+			name != "" && /^type *=/ {
+				sub(/^type *= */, "")
+				n = split($0, types, ";")
+				match_type = 0
+				for (i = 1; i <= n; i++)
+					if (types[i] == fstype)
+						match_type = 1
+			}
+			END { flush() }' "$config"
+	fi
+}
+
+# Source data, written once so every profile copies the same bytes
+echo "Creating $size MB file and $files small files"
+dd if=/dev/urandom of="$tmpdir/large" bs=1M count=$size 2>/dev/null || die "can not create test data"
+mkdir "$tmpdir/small"
+dd if=/dev/urandom of="$tmpdir/chunk" bs=16k count=1 2>/dev/null
+i=0
+while [ $i -lt $files ]; do
+	mkdir -p "$tmpdir/small/$((i / 100))"
+	cp "$tmpdir/chunk" "$tmpdir/small/$((i / 100))/$i"
+	i=$((i + 1))
+done
+small_kb=$((files * 16))
+
+# Formatted as a plain file, the loop device itself is only writable by root
+image=$(mktemp "$imagedir/bench-profiles.XXXXXX.img") || die "can not create image in $imagedir"
+truncate -s $((size * 2 + small_kb * 2 / 1024 + 64))M "$image" || die "can not create image"
+$mkfs "$image" >/dev/null 2>&1 || die "can not create $fstype on $image"
+loop=$(udisksctl loop-setup --no-user-interaction -f "$image" | sed -n 's/.* as \(\/dev\/[^ ]*\)\.$/\1/p')
+[ -n "$loop" ] || die "can not set up loop device"
+
+now_ms()
+{
+	date +%s%3N
+}
+
+# copy SOURCE: copy into the mounted image, print milliseconds until it is written out
+copy()
+{
+	start=$(now_ms)
+	cp -r "$1" "$mountpoint/" || return 1
+	sync -f "$mountpoint"
+	echo $(($(now_ms) - start))
+}
+
+printf "%-16s %-32s %12s %12s\n" PROFILE OPTIONS "LARGE MB/s" "SMALL MB/s"
+
+# Not a pipe, so the loop runs in this shell and cleanup sees the mount
+profiles "$@" >"$tmpdir/profiles"
+
+while IFS= read -r line; do
+	name=${line%%=*}
+	options=${line#*=}
+
+	if [ -n "$options" ]; then
+		out=$(udisksctl mount --no-user-interaction -b "$loop" -o "$options" 2>&1)
+	else
+		out=$(udisksctl mount --no-user-interaction -b "$loop" 2>&1)
+	fi
+	mountpoint=$(echo "$out" | sed -n 's/^Mounted .* at \(.*\)$/\1/p' | sed 's/\.$//')
+	if [ -z "$mountpoint" ]; then
+		printf "%-16s %-32s %s\n" "$name" "$options" "mount failed: $out"
+		continue
+	fi
+
+	large_ms=$(copy "$tmpdir/large")
+	small_ms=$(copy "$tmpdir/small")
+	rm -rf "$mountpoint/large" "$mountpoint/small"
+	sync -f "$mountpoint"
+
+	udisksctl unmount --no-user-interaction -b "$loop" >/dev/null || die "can not unmount $loop"
+	mountpoint=""
+
+	printf "%-16s %-32s %12s %12s\n" "$name" "$options" \
+		$(awk -v kb=$((size * 1024)) -v ms="$large_ms" 'BEGIN { printf "%.1f", ms ? kb / 1024 / (ms / 1000) : 0 }') \
+		$(awk -v kb=$small_kb -v ms="$small_ms" 'BEGIN { printf "%.1f", ms ? kb / 1024 / (ms / 1000) : 0 }')
+done <"$tmpdir/profiles"
+
+exit 0
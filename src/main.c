@@ -30,14 +30,29 @@
 
 #include "ui.h"
 #include "udisks.h"
+#include "theme.h"
+#include "trace.h"
+#include "stats.h"
+#include "settings.h"
 
 int main(int argc, char *argv[])
 {
 	static char *dpyName = "";
 	static char *theme = "default";
+	static int fps = 25;
+	static char *record = NULL;
+	static char *replay = NULL;
+	static char *stats = NULL;
 	static DAProgramOption op[] = {
 		{"-d", "--display", "display to use", DOString, False, {&dpyName} },
-		{"-t", "--theme", "icon theme", DOString, False, {&theme} }
+		{"-t", "--theme", "icon theme", DOString, False, {&theme} },
+		{"-f", "--fps", "maximum repaints per second", DONatural, False, {&fps} },
+		{"-s", "--smooth", "scroll text by pixels", DONone, False, {NULL} },
+		{"-c", "--compile-theme", "write icon theme cache and exit", DONone, False, {NULL} },
+		{"-r", "--record", "record UDisks signals to file", DOString, False, {&record} },
+		{"-p", "--replay", "replay UDisks signals from file", DOString, False, {&replay} },
+		{"-F", "--replay-fast", "replay without original delays", DONone, False, {NULL} },
+		{"-S", "--stats", "append statistics to file on SIGUSR1", DOString, False, {&stats} }
 	};
 
 	DAParseArguments(argc, argv, op,
@@ -45,12 +60,28 @@ int main(int argc, char *argv[])
 					 "",
 					 PACKAGE_NAME " version " PACKAGE_VERSION);
 
-	if (!wmvm_init_dockapp(dpyName, argc, argv, theme))
-		return 1;
+	if (op[4].used) {
+		wmvm_theme_init(theme);
+		return wmvm_theme_compile() ? 0 : 1;
+	}
+
+	wmvm_stats_init(stats);
+	wmvm_settings_load();
 
-	if (!wmvm_do_udisks_init())
+	if (!wmvm_init_dockapp(dpyName, argc, argv, theme, fps, op[3].used))
 		return 1;
 
+	if (replay != NULL) {
+		if (!wmvm_trace_replay(replay, op[7].used))
+			return 1;
+	} else {
+		if (record != NULL && !wmvm_trace_record_start(record))
+			return 1;
+
+		if (!wmvm_do_udisks_init())
+			return 1;
+	}
+
 	wmvm_update_icon();
 
 	wmvm_run_dockapp();
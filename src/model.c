@@ -0,0 +1,380 @@
+/*
+ * model.c - Window Maker Volume Manager, volume list
+ *
+ * Copyright (C) 2005,2010  Alexey I. Froloff <raorn@altlinux.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "model.h"
+#include "stats.h"
+#include "ui.h"
+
+/* Volumes in display order, plus object path -> volume index */
+static GQueue wmvm_volumes = G_QUEUE_INIT;
+static GHashTable *wmvm_volume_index = NULL;
+static WMVMVolume *current = NULL;
+
+/* Inside wmvm_begin_update()/wmvm_commit_update() */
+static int batch_depth = 0;
+static gboolean batch_added = FALSE;
+
+static const WMVMModelObserver *observer = NULL;
+
+void wmvm_model_set_observer(const WMVMModelObserver *o)
+{
+	observer = o;
+}
+
+static void wmvm_model_changed(WMVMVolume *vol, guint what)
+{
+	wmvm_stat_inc(WMVM_STAT_MODEL_CHANGE);
+
+	if (observer != NULL && observer->changed != NULL)
+		observer->changed(vol, what);
+}
+
+gboolean wmvm_model_in_update(void)
+{
+	return batch_depth > 0;
+}
+
+WMVMVolume *wmvm_model_current(void)
+{
+	return current;
+}
+
+void wmvm_model_set_current(WMVMVolume *newcur)
+{
+	if (current != newcur) {
+		current = newcur;
+		wmvm_model_changed(current, WMVM_CHANGED_CURRENT);
+	}
+}
+
+WMVMVolume *wmvm_model_first(void)
+{
+	return g_queue_peek_head(&wmvm_volumes);
+}
+
+WMVMVolume *wmvm_model_prev(WMVMVolume *vol)
+{
+	if (vol == NULL || g_list_previous(vol->link) == NULL)
+		return NULL;
+
+	return g_list_previous(vol->link)->data;
+}
+
+WMVMVolume *wmvm_model_next(WMVMVolume *vol)
+{
+	if (vol == NULL || g_list_next(vol->link) == NULL)
+		return NULL;
+
+	return g_list_next(vol->link)->data;
+}
+
+static void wmvm_free_volume(WMVMVolume *vol)
+{
+	if (vol == NULL)
+		return;
+
+	wmvm_stat_inc(WMVM_STAT_VOLUME_REMOVED);
+
+	if (observer != NULL && observer->freeing != NULL)
+		observer->freeing(vol);
+
+	if (vol->device) free(vol->device);
+	if (vol->mountpoint) free(vol->mountpoint);
+	g_free(vol->title);
+	free(vol);
+}
+
+static void wmvm_set_title(WMVMVolume *vol)
+{
+	g_free(vol->title);
+	vol->title = NULL;
+
+	if (vol->mountpoint && *vol->mountpoint) {
+		if (vol->profile != NULL)
+			vol->display_name = vol->title = g_strdup_printf("%s (%s)", vol->mountpoint, vol->profile);
+		else
+			vol->display_name = vol->mountpoint;
+	} else {
+		vol->display_name = vol->device;
+	}
+
+	wmvm_model_changed(vol, WMVM_CHANGED_TITLE);
+}
+
+static WMVMVolume *wmvm_find_volume(const char *udi)
+{
+	if (udi == NULL || wmvm_volume_index == NULL)
+		return NULL;
+
+	return g_hash_table_lookup(wmvm_volume_index, udi);
+}
+
+gboolean wmvm_is_managed_volume(const char *udi)
+{
+	return (wmvm_find_volume(udi) != NULL);
+}
+
+void wmvm_update_volume(const char *udi, const char *device, int icon, gboolean mountable)
+{
+	WMVMVolume *vol;
+	gboolean is_new;
+
+	if (udi == NULL || device == NULL)
+		return;
+
+	is_new = FALSE;
+	vol = wmvm_find_volume(udi);
+
+	if (vol == NULL) {
+		is_new = TRUE;
+		vol = calloc(1, sizeof(WMVMVolume));
+
+		if (vol == NULL)
+			return;
+
+		wmvm_stat_inc(WMVM_STAT_VOLUME_ADDED);
+	}
+
+	if (is_new) {
+		vol->udi = g_intern_string(udi);
+		vol->device = strdup(device);
+	}
+	vol->mountable = mountable;
+	vol->busy = FALSE;
+	vol->stale = FALSE;
+	if (icon >= WMVM_ICON_UNKNOWN && icon < WMVM_ICON_MAX)
+		vol->icon = icon;
+	else
+		vol->icon = WMVM_ICON_UNKNOWN;
+
+	if (is_new) {
+		wmvm_set_title(vol);
+
+		if (wmvm_volume_index == NULL)
+			wmvm_volume_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+		g_queue_push_tail(&wmvm_volumes, vol);
+		vol->link = wmvm_volumes.tail;
+		g_hash_table_insert(wmvm_volume_index, (gpointer) vol->udi, vol);
+	}
+
+	/* Selection is decided once, on commit */
+	if (batch_depth > 0) {
+		batch_added = batch_added || is_new;
+		return;
+	}
+
+	wmvm_model_changed(vol, WMVM_CHANGED_STATE | WMVM_CHANGED_ICON);
+
+	if (current == NULL || observer == NULL || observer->may_select == NULL || observer->may_select())
+		wmvm_model_set_current(vol);
+	else
+		wmvm_model_changed(NULL, WMVM_CHANGED_LIST);
+}
+
+static gint wmvm_compare_volumes(gconstpointer a, gconstpointer b, gpointer data)
+{
+	return strcmp(((const WMVMVolume *) a)->device, ((const WMVMVolume *) b)->device);
+}
+
+/*
+ * Group many model changes: volumes are sorted, selection is decided and
+ * observer is notified once, when outermost transaction is committed.
+ */
+void wmvm_begin_update(void)
+{
+	batch_depth++;
+}
+
+void wmvm_commit_update(void)
+{
+	if (batch_depth == 0 || --batch_depth > 0)
+		return;
+
+	if (batch_added) {
+		g_queue_sort(&wmvm_volumes, wmvm_compare_volumes, NULL);
+		batch_added = FALSE;
+	}
+
+	if (current == NULL)
+		wmvm_model_set_current(g_queue_peek_head(&wmvm_volumes));
+
+	wmvm_model_changed(NULL, WMVM_CHANGED_ALL);
+}
+
+void wmvm_remove_volume(const char *udi)
+{
+	WMVMVolume *vol;
+
+	if ((vol = wmvm_find_volume(udi)) == NULL)
+		return;
+
+	if (current == vol) {
+		if (wmvm_model_prev(vol))
+			wmvm_model_set_current(wmvm_model_prev(vol));
+		else
+			wmvm_model_set_current(wmvm_model_next(vol));
+	}
+
+	g_hash_table_remove(wmvm_volume_index, vol->udi);
+	g_queue_delete_link(&wmvm_volumes, vol->link);
+	wmvm_free_volume(vol);
+
+	wmvm_model_changed(NULL, WMVM_CHANGED_LIST);
+}
+
+void wmvm_remove_all_volumes(void)
+{
+	WMVMVolume *vol;
+
+	wmvm_model_set_current(NULL);
+
+	if (wmvm_volume_index)
+		g_hash_table_remove_all(wmvm_volume_index);
+
+	while ((vol = g_queue_pop_head(&wmvm_volumes)) != NULL)
+		wmvm_free_volume(vol);
+
+	wmvm_model_changed(NULL, WMVM_CHANGED_ALL);
+}
+
+/*
+ * Resync support: mark every volume, let updates clear the mark, then
+ * remove what is left.  Unchanged volumes are never torn down.
+ */
+void wmvm_mark_volumes_stale(void)
+{
+	GList *l;
+
+	for (l = wmvm_volumes.head; l != NULL; l = g_list_next(l))
+		((WMVMVolume *) l->data)->stale = TRUE;
+}
+
+void wmvm_remove_stale_volumes(void)
+{
+	GList *l, *next;
+
+	for (l = wmvm_volumes.head; l != NULL; l = next) {
+		WMVMVolume *vol = l->data;
+
+		next = g_list_next(l);
+		if (vol->stale)
+			wmvm_remove_volume(vol->udi);
+	}
+}
+
+void wmvm_volume_set_mount_status(const char *udi, const char *mountpoint, gboolean mounted)
+{
+	WMVMVolume *vol;
+
+	if ((vol = wmvm_find_volume(udi)) == NULL)
+		return;
+
+	if (vol->mounted != mounted) {
+		vol->mounted = mounted;
+
+		wmvm_model_changed(vol, WMVM_CHANGED_MOUNT);
+
+		/* Profile belongs to one mount */
+		if (!mounted && vol->profile != NULL) {
+			vol->profile = NULL;
+			wmvm_set_title(vol);
+		}
+	}
+
+	if ((vol->mountpoint != NULL && mountpoint != NULL && strcmp(vol->mountpoint, mountpoint)) ||
+		(vol->mountpoint == NULL && mountpoint != NULL) ||
+		(vol->mountpoint != NULL && mountpoint == NULL)) {
+		if (vol->mountpoint) free(vol->mountpoint);
+		vol->mountpoint = NULL;
+		if (mountpoint)
+			vol->mountpoint = strdup(mountpoint);
+
+		wmvm_set_title(vol);
+	}
+}
+
+void wmvm_volume_set_icon(const char *udi, int icon)
+{
+	WMVMVolume *vol;
+
+	if ((vol = wmvm_find_volume(udi)) == NULL)
+		return;
+
+	if (icon < WMVM_ICON_UNKNOWN || icon >= WMVM_ICON_MAX)
+		icon = WMVM_ICON_UNKNOWN;
+
+	if (vol->icon != icon) {
+		vol->icon = icon;
+
+		wmvm_model_changed(vol, WMVM_CHANGED_ICON);
+	}
+}
+
+void wmvm_volume_set_busy(const char *udi, gboolean busy)
+{
+	WMVMVolume *vol;
+
+	if ((vol = wmvm_find_volume(udi)) == NULL)
+		return;
+
+	if (vol->busy != busy) {
+		vol->busy = busy;
+
+		wmvm_model_changed(vol, WMVM_CHANGED_STATE);
+	}
+}
+
+void wmvm_volume_set_error(const char *udi, gboolean error)
+{
+	WMVMVolume *vol;
+
+	if ((vol = wmvm_find_volume(udi)) == NULL)
+		return;
+
+	if (vol->error != error) {
+		vol->error = error;
+
+		wmvm_model_changed(vol, WMVM_CHANGED_STATE);
+	}
+}
+
+void wmvm_volume_set_profile(const char *udi, const char *profile)
+{
+	WMVMVolume *vol;
+
+	if ((vol = wmvm_find_volume(udi)) == NULL)
+		return;
+
+	if (vol->profile != profile) {
+		vol->profile = profile;
+
+		wmvm_set_title(vol);
+	}
+}
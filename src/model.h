@@ -0,0 +1,86 @@
+/*
+ * model.h - Window Maker Volume Manager, volume list
+ *
+ * Copyright (C) 2005,2010  Alexey I. Froloff <raorn@altlinux.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __WMVM_MODEL_H__
+#define __WMVM_MODEL_H__
+
+#include <glib.h>
+
+typedef struct _WMVMVolume {
+	const char *udi;	/* interned, never freed */
+	char *device;
+	char *mountpoint;
+	char *display_name;
+	char *title;		/* mountpoint with profile, if any */
+	const char *profile;	/* mount profile, interned */
+	gboolean mountable;
+	int icon;			/* enum WMVMIconName */
+	gboolean mounted;
+	gboolean busy;
+	gboolean error;		/* last mount or unmount failed, until next one */
+	gboolean stale;		/* not seen since wmvm_mark_volumes_stale() */
+	GList *link;		/* position in volume list */
+	gpointer view;		/* observer data, released by freeing() */
+} WMVMVolume;
+
+/* What changed, as reported to the observer */
+#define WMVM_CHANGED_TITLE		(1 << 0)
+#define WMVM_CHANGED_MOUNT		(1 << 1)
+#define WMVM_CHANGED_ICON		(1 << 2)
+#define WMVM_CHANGED_STATE		(1 << 3)	/* mountable, busy or error */
+#define WMVM_CHANGED_LIST		(1 << 4)	/* volumes added, removed or sorted */
+#define WMVM_CHANGED_CURRENT	(1 << 5)
+#define WMVM_CHANGED_ALL		(WMVM_CHANGED_TITLE | WMVM_CHANGED_MOUNT | WMVM_CHANGED_ICON | \
+								 WMVM_CHANGED_STATE | WMVM_CHANGED_LIST)
+
+/*
+ * The model never draws.  Changes are reported for a volume, or for
+ * the whole list when volume is NULL.
+ */
+typedef struct _WMVMModelObserver {
+	void (*changed)(WMVMVolume *vol, guint what);
+	void (*freeing)(WMVMVolume *vol);
+	gboolean (*may_select)(void);	/* new volumes become current */
+} WMVMModelObserver;
+
+void wmvm_model_set_observer(const WMVMModelObserver *observer);
+gboolean wmvm_model_in_update(void);
+WMVMVolume *wmvm_model_current(void);
+void wmvm_model_set_current(WMVMVolume *vol);
+WMVMVolume *wmvm_model_first(void);
+WMVMVolume *wmvm_model_prev(WMVMVolume *vol);
+WMVMVolume *wmvm_model_next(WMVMVolume *vol);
+
+gboolean wmvm_is_managed_volume(const char *udi);
+void wmvm_begin_update(void);
+void wmvm_commit_update(void);
+void wmvm_update_volume(const char *udi, const char *device, int icon, gboolean mountable);
+void wmvm_remove_volume(const char *udi);
+void wmvm_remove_all_volumes(void);
+void wmvm_mark_volumes_stale(void);
+void wmvm_remove_stale_volumes(void);
+void wmvm_volume_set_mount_status(const char *udi, const char *mountpoint, gboolean mounted);
+void wmvm_volume_set_icon(const char *udi, int icon);
+void wmvm_volume_set_busy(const char *udi, gboolean busy);
+void wmvm_volume_set_error(const char *udi, gboolean error);
+void wmvm_volume_set_profile(const char *udi, const char *profile);
+
+#endif
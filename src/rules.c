@@ -0,0 +1,219 @@
+/*
+ * rules.c - Window Maker Volume Manager, volume matching rules
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "rules.h"
+
+/*
+ * Rules are [automount NAME] and [profile NAME] groups, tried in file
+ * order, first match wins.  Every match key is a list of accepted
+ * values, a missing key accepts anything.  Values are compiled to
+ * quarks, so matching a volume is a few hash lookups and then integer
+ * compares, without allocation.
+ */
+enum {
+	FIELD_BUS = 0,
+	FIELD_MEDIA,
+	FIELD_TYPE,
+	FIELD_LABEL,
+	FIELD_UUID,
+	FIELD_MAX
+};
+
+static const char *wmvm_rule_keys[FIELD_MAX] = {
+	"bus",		/* FIELD_BUS */
+	"media",	/* FIELD_MEDIA */
+	"type",		/* FIELD_TYPE */
+	"label",	/* FIELD_LABEL */
+	"uuid"		/* FIELD_UUID */
+};
+
+typedef struct _WMVMRule {
+	guint first[FIELD_MAX];	/* into table values */
+	guint count[FIELD_MAX];	/* 0 matches anything */
+	const char *name;		/* interned, group name without prefix */
+	gboolean mount;			/* automount */
+	const char *options;	/* profile, interned */
+} WMVMRule;
+
+typedef struct _WMVMRuleTable {
+	const char *prefix;
+	GArray *rules;
+	GArray *values;		/* GQuark */
+} WMVMRuleTable;
+
+static WMVMRuleTable automount_rules = {"automount"};
+static WMVMRuleTable profile_rules = {"profile"};
+
+static void _compile_rule(WMVMRuleTable *table, GKeyFile *settings, const gchar *group)
+{
+	WMVMRule rule;
+	GError *error = NULL;
+	gchar *options;
+	int f;
+
+	for (f = 0; f < FIELD_MAX; f++) {
+		gchar **list, **v;
+
+		rule.first[f] = table->values->len;
+		rule.count[f] = 0;
+
+		if ((list = g_key_file_get_string_list(settings, group, wmvm_rule_keys[f], NULL, NULL)) == NULL)
+			continue;
+
+		for (v = list; *v != NULL; v++) {
+			GQuark q = g_quark_from_string(*v);
+
+			g_array_append_val(table->values, q);
+			rule.count[f]++;
+		}
+
+		g_strfreev(list);
+	}
+
+	rule.name = g_intern_string(group[strlen(table->prefix)] ? group + strlen(table->prefix) + 1 : group);
+
+	rule.mount = TRUE;
+	if (g_key_file_has_key(settings, group, "mount", NULL)) {
+		rule.mount = g_key_file_get_boolean(settings, group, "mount", &error);
+		if (error != NULL) {
+			fprintf(stderr, "[%s]: %s\n", group, error->message);
+			g_error_free(error);
+			rule.mount = FALSE;
+		}
+	}
+
+	rule.options = NULL;
+	if ((options = g_key_file_get_string(settings, group, "options", NULL)) != NULL) {
+		rule.options = g_intern_string(g_strstrip(options));
+		g_free(options);
+	}
+
+	g_array_append_val(table->rules, rule);
+}
+
+static void _compile_table(WMVMRuleTable *table, GKeyFile *settings, gchar **groups)
+{
+	gsize len = strlen(table->prefix);
+	gchar **g;
+
+	if (table->rules != NULL) {
+		g_array_free(table->rules, TRUE);
+		g_array_free(table->values, TRUE);
+	}
+
+	table->rules = g_array_new(FALSE, FALSE, sizeof(WMVMRule));
+	table->values = g_array_new(FALSE, FALSE, sizeof(GQuark));
+
+	for (g = groups; *g != NULL; g++)
+		if (strncmp(*g, table->prefix, len) == 0 && ((*g)[len] == '\0' || (*g)[len] == ' '))
+			_compile_rule(table, settings, *g);
+
+	g_debug("%u %s rules", table->rules->len, table->prefix);
+}
+
+void wmvm_rules_compile(GKeyFile *settings)
+{
+	gchar **groups = g_key_file_get_groups(settings, NULL);
+
+	_compile_table(&automount_rules, settings, groups);
+	_compile_table(&profile_rules, settings, groups);
+
+	g_strfreev(groups);
+}
+
+/* Unknown strings have no quark yet and can only match "anything" */
+static GQuark _try_quark(const char *value)
+{
+	if (value == NULL || *value == '\0')
+		return 0;
+
+	return g_quark_try_string(value);
+}
+
+static const WMVMRule *_match(const WMVMRuleTable *table, const char *bus, const char *media,
+							  const char *fstype, const char *label, const char *uuid)
+{
+	const GQuark *values;
+	GQuark q[FIELD_MAX];
+	guint i, j;
+	int f;
+
+	if (table->rules == NULL || table->rules->len == 0)
+		return NULL;
+
+	q[FIELD_BUS] = _try_quark(bus);
+	q[FIELD_MEDIA] = _try_quark(media);
+	q[FIELD_TYPE] = _try_quark(fstype);
+	q[FIELD_LABEL] = _try_quark(label);
+	q[FIELD_UUID] = _try_quark(uuid);
+
+	values = (const GQuark *) table->values->data;
+
+	for (i = 0; i < table->rules->len; i++) {
+		const WMVMRule *rule = &g_array_index(table->rules, WMVMRule, i);
+
+		for (f = 0; f < FIELD_MAX; f++) {
+			if (rule->count[f] == 0)
+				continue;
+
+			for (j = 0; j < rule->count[f]; j++)
+				if (values[rule->first[f] + j] == q[f])
+					break;
+			if (j == rule->count[f])
+				break;
+		}
+
+		if (f == FIELD_MAX)
+			return rule;
+	}
+
+	return NULL;
+}
+
+gboolean wmvm_automount_match(const char *bus, const char *media, const char *fstype,
+							  const char *label, const char *uuid)
+{
+	const WMVMRule *rule = _match(&automount_rules, bus, media, fstype, label, uuid);
+
+	return rule != NULL && rule->mount;
+}
+
+/* Profile name and its mount options, NULL if no profile applies */
+const char *wmvm_profile_match(const char *bus, const char *media, const char *fstype,
+							   const char *label, const char *uuid, const char **options)
+{
+	const WMVMRule *rule = _match(&profile_rules, bus, media, fstype, label, uuid);
+
+	if (rule == NULL)
+		return NULL;
+
+	*options = rule->options;
+	return rule->name;
+}
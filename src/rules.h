@@ -0,0 +1,34 @@
+/*
+ * rules.h - Window Maker Volume Manager, volume matching rules
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifndef __WMVM_RULES_H__
+#define __WMVM_RULES_H__
+
+#include <glib.h>
+
+void wmvm_rules_compile(GKeyFile *settings);
+gboolean wmvm_automount_match(const char *bus, const char *media, const char *fstype,
+							  const char *label, const char *uuid);
+const char *wmvm_profile_match(const char *bus, const char *media, const char *fstype,
+							   const char *label, const char *uuid, const char **options);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * settings.c - Window Maker Volume Manager, configuration file
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "settings.h"
+#include "rules.h"
+
+/* Seconds to wait for udisksd to mount or unmount a volume */
+#define DEFAULT_TIMEOUT		30
+
+/* ~/.wmvolman/wmvolman.conf, missing file means defaults */
+static GKeyFile *settings = NULL;
+
+void wmvm_settings_load(void)
+{
+	const gchar *home = g_getenv("HOME");
+	gchar *file;
+	GError *error = NULL;
+
+	settings = g_key_file_new();
+
+	if (home == NULL || *home == '\0')
+		return;
+
+	file = g_build_filename(home, ".wmvolman", "wmvolman.conf", NULL);
+
+	if (!g_key_file_load_from_file(settings, file, G_KEY_FILE_NONE, &error)) {
+		if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			fprintf(stderr, "%s: %s\n", file, error->message);
+		g_error_free(error);
+	}
+
+	g_free(file);
+
+	wmvm_rules_compile(settings);
+}
+
+static gint _get_integer(const gchar *group, const gchar *key)
+{
+	GError *error = NULL;
+	gint value;
+
+	if (settings == NULL || key == NULL)
+		return -1;
+
+	value = g_key_file_get_integer(settings, group, key, &error);
+	if (error != NULL) {
+		g_error_free(error);
+		return -1;
+	}
+
+	return value;
+}
+
+/* [timeouts] has "default" and per connection bus keys, "usb", "sdio"... */
+guint wmvm_settings_get_timeout(const char *bus)
+{
+	gint timeout;
+
+	if ((timeout = _get_integer("timeouts", bus)) > 0)
+		return timeout;
+	if ((timeout = _get_integer("timeouts", "default")) > 0)
+		return timeout;
+
+	return DEFAULT_TIMEOUT;
+}
@@ -0,0 +1,154 @@
+/*
+ * stats.c - Window Maker Volume Manager, runtime statistics
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <signal.h>
+#include <stdio.h>
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "stats.h"
+
+guint64 wmvm_stats[WMVM_STAT_MAX];
+
+static const char *wmvm_stat_names[WMVM_STAT_MAX] = {
+	"object-added signals",			/* WMVM_STAT_OBJECT_ADDED */
+	"object-removed signals",		/* WMVM_STAT_OBJECT_REMOVED */
+	"interface-added signals",		/* WMVM_STAT_INTERFACE_ADDED */
+	"interface-removed signals",	/* WMVM_STAT_INTERFACE_REMOVED */
+	"properties-changed signals",	/* WMVM_STAT_PROPERTIES_CHANGED */
+	"object updates",				/* WMVM_STAT_UPDATE_OBJECT */
+	"model changes",				/* WMVM_STAT_MODEL_CHANGE */
+	"volumes added",				/* WMVM_STAT_VOLUME_ADDED */
+	"volumes removed",				/* WMVM_STAT_VOLUME_REMOVED */
+	"repaints",						/* WMVM_STAT_REPAINT */
+	"main loop iterations",			/* WMVM_STAT_LOOP_ITERATION */
+	"X requests",					/* WMVM_STAT_X_REQUEST */
+	"X reads",						/* WMVM_STAT_X_READ */
+	"X flushes",					/* WMVM_STAT_X_FLUSH */
+	"timer wakeups"					/* WMVM_STAT_TIMER_WAKEUP */
+};
+
+/* Bucket n counts values below 2^n microseconds, the last one the rest */
+#define HIST_BUCKETS	32
+
+static struct WMVMHistogram {
+	const char *name;
+	guint64 count;
+	gint64 sum, max;
+	guint64 buckets[HIST_BUCKETS];
+} wmvm_histograms[WMVM_HIST_MAX] = {
+	{"signal to paint"},	/* WMVM_HIST_SIGNAL_TO_PAINT */
+	{"mount"},				/* WMVM_HIST_MOUNT */
+	{"unmount"},			/* WMVM_HIST_UNMOUNT */
+	{"detach"},				/* WMVM_HIST_DETACH */
+	{"hotplug to mounted"}	/* WMVM_HIST_AUTOMOUNT */
+};
+
+static gint64 stats_start;
+static const char *stats_file = NULL;
+
+void wmvm_stat_record(enum WMVMStatHistogram histogram, gint64 usec)
+{
+	struct WMVMHistogram *h = &wmvm_histograms[histogram];
+	int bucket = 0;
+
+	if (usec < 0)
+		usec = 0;
+
+	while (bucket < HIST_BUCKETS - 1 && usec >= ((gint64) 1 << bucket))
+		bucket++;
+
+	h->buckets[bucket]++;
+	h->count++;
+	h->sum += usec;
+	if (usec > h->max)
+		h->max = usec;
+}
+
+/* Upper bound of the bucket holding given fraction of values */
+static gint64 _percentile(const struct WMVMHistogram *h, double fraction)
+{
+	guint64 seen = 0;
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= h->count * fraction)
+			return MIN((gint64) 1 << i, h->max);
+	}
+
+	return h->max;
+}
+
+void wmvm_stats_dump(FILE *file)
+{
+	int i;
+
+	fprintf(file, "wmvolman statistics, %" G_GINT64_FORMAT " s uptime\n",
+			(g_get_monotonic_time() - stats_start) / G_USEC_PER_SEC);
+
+	for (i = 0; i < WMVM_STAT_MAX; i++)
+		fprintf(file, "  %-28s %" G_GUINT64_FORMAT "\n", wmvm_stat_names[i], wmvm_stats[i]);
+
+	for (i = 0; i < WMVM_HIST_MAX; i++) {
+		const struct WMVMHistogram *h = &wmvm_histograms[i];
+
+		if (h->count == 0) {
+			fprintf(file, "  %-28s no samples\n", h->name);
+			continue;
+		}
+
+		fprintf(file, "  %-28s %" G_GUINT64_FORMAT " samples, us: avg %" G_GINT64_FORMAT
+				", p50 %" G_GINT64_FORMAT ", p90 %" G_GINT64_FORMAT ", p99 %" G_GINT64_FORMAT
+				", max %" G_GINT64_FORMAT "\n",
+				h->name, h->count, h->sum / (gint64) h->count,
+				_percentile(h, 0.5), _percentile(h, 0.9), _percentile(h, 0.99), h->max);
+	}
+
+	fflush(file);
+}
+
+static gboolean _dump_signal(gpointer user_data)
+{
+	FILE *file;
+
+	if (stats_file != NULL && (file = fopen(stats_file, "a")) != NULL) {
+		wmvm_stats_dump(file);
+		fclose(file);
+	} else {
+		wmvm_stats_dump(stderr);
+	}
+
+	return TRUE;
+}
+
+/* Dump is written on SIGUSR1, to given file or to stderr */
+void wmvm_stats_init(const char *filename)
+{
+	stats_start = g_get_monotonic_time();
+	stats_file = filename;
+
+	g_unix_signal_add(SIGUSR1, _dump_signal, NULL);
+}
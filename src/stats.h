@@ -0,0 +1,65 @@
+/*
+ * stats.h - Window Maker Volume Manager, runtime statistics
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __WMVM_STATS_H__
+#define __WMVM_STATS_H__
+
+#include <stdio.h>
+#include <glib.h>
+
+enum WMVMStatCounter {
+	WMVM_STAT_OBJECT_ADDED = 0,
+	WMVM_STAT_OBJECT_REMOVED,
+	WMVM_STAT_INTERFACE_ADDED,
+	WMVM_STAT_INTERFACE_REMOVED,
+	WMVM_STAT_PROPERTIES_CHANGED,
+	WMVM_STAT_UPDATE_OBJECT,
+	WMVM_STAT_MODEL_CHANGE,
+	WMVM_STAT_VOLUME_ADDED,
+	WMVM_STAT_VOLUME_REMOVED,
+	WMVM_STAT_REPAINT,
+	WMVM_STAT_LOOP_ITERATION,
+	WMVM_STAT_X_REQUEST,
+	WMVM_STAT_X_READ,
+	WMVM_STAT_X_FLUSH,
+	WMVM_STAT_TIMER_WAKEUP,
+	WMVM_STAT_MAX
+};
+
+enum WMVMStatHistogram {
+	WMVM_HIST_SIGNAL_TO_PAINT = 0,
+	WMVM_HIST_MOUNT,
+	WMVM_HIST_UNMOUNT,
+	WMVM_HIST_DETACH,
+	WMVM_HIST_AUTOMOUNT,
+	WMVM_HIST_MAX
+};
+
+/* Counting is a single increment, nothing else happens until a dump */
+extern guint64 wmvm_stats[WMVM_STAT_MAX];
+
+#define wmvm_stat_inc(counter)	(wmvm_stats[(counter)]++)
+
+void wmvm_stat_record(enum WMVMStatHistogram histogram, gint64 usec);
+void wmvm_stats_init(const char *filename);
+void wmvm_stats_dump(FILE *file);
+
+#endif
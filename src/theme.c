@@ -0,0 +1,492 @@
+/*
+ * theme.c - Window Maker Volume Manager, icon themes
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <dockapp.h>
+#include <X11/xpm.h>
+
+#include "ui.h"
+#include "theme.h"
+
+static struct WMVMDeviceIconDesc {
+	char *name;
+	enum WMVMIconName fallback;
+} wmvm_device_icon_names[WMVM_ICON_MAX] = {
+	{"unknown.xpm", -1},                             /* WMVM_ICON_UNKNOWN = 0, */
+	{"cdrom-unknown.xpm", WMVM_ICON_UNKNOWN},        /* WMVM_ICON_CD_UNKNOWN, */
+	{"cdrom.xpm", WMVM_ICON_CD_UNKNOWN},             /* WMVM_ICON_CDROM, */
+	{"disc-audio.xpm", WMVM_ICON_CDROM},             /* WMVM_ICON_CDAUDIO, */
+	{"disc-cdr.xpm", WMVM_ICON_CDROM},               /* WMVM_ICON_CDR, */
+	{"disc-cdrw.xpm", WMVM_ICON_CDROM},              /* WMVM_ICON_CDRW, */
+	{"disc-dvdrom.xpm", WMVM_ICON_CDROM},            /* WMVM_ICON_DVDROM, */
+	{"disc-dvdram.xpm", WMVM_ICON_DVDROM},           /* WMVM_ICON_DVDRAM, */
+	{"disc-dvdr.xpm", WMVM_ICON_DVDROM},             /* WMVM_ICON_DVDR, */
+	{"disc-dvdrw.xpm", WMVM_ICON_DVDROM},            /* WMVM_ICON_DVDRW, */
+	{"disc-dvdr-plus.xpm", WMVM_ICON_DVDROM},        /* WMVM_ICON_DVDPLUSR, */
+	{"disc-dvdrw-plus.xpm", WMVM_ICON_DVDROM},       /* WMVM_ICON_DVDPLUSRW, */
+	{"disc-bd.xpm", WMVM_ICON_CDROM},                /* WMVM_ICON_BD, */
+	{"disc-bdr.xpm", WMVM_ICON_BD},                  /* WMVM_ICON_BDR, */
+	{"disc-bdre.xpm", WMVM_ICON_BD},                 /* WMVM_ICON_BDRE, */
+	{"disc-hddvd.xpm", WMVM_ICON_CDROM},             /* WMVM_ICON_HDDVD, */
+	{"disc-hddvdr.xpm", WMVM_ICON_HDDVD},            /* WMVM_ICON_HDDVDR, */
+	{"disc-hddvdrw.xpm", WMVM_ICON_HDDVD},           /* WMVM_ICON_HDDVDRW, */
+	{"harddisk.xpm", WMVM_ICON_UNKNOWN},             /* WMVM_ICON_HARDDISK, */
+	{"harddisk-usb.xpm", WMVM_ICON_HARDDISK},        /* WMVM_ICON_HARDDISK_USB, */
+	{"harddisk-1394.xpm", WMVM_ICON_HARDDISK},       /* WMVM_ICON_HARDDISK_1394, */
+	{"removable.xpm", WMVM_ICON_HARDDISK},           /* WMVM_ICON_REMOVABLE, */
+	{"removable-usb.xpm", WMVM_ICON_HARDDISK_USB},   /* WMVM_ICON_REMOVABLE_USB, */
+	{"removable-1394.xpm", WMVM_ICON_HARDDISK_1394}, /* WMVM_ICON_REMOVABLE_1394, */
+	{"card-cf.xpm", WMVM_ICON_REMOVABLE},            /* WMVM_ICON_CARD_CF, */
+	{"card-ms.xpm", WMVM_ICON_REMOVABLE},            /* WMVM_ICON_CARD_MS, */
+	{"card-sdmmc.xpm", WMVM_ICON_REMOVABLE},         /* WMVM_ICON_CARD_SDMMC, */
+	{"card-sm.xpm", WMVM_ICON_REMOVABLE},            /* WMVM_ICON_CARD_SM, */
+	{"harddisk-sdio.xpm", WMVM_ICON_HARDDISK},       /* WMVM_ICON_HARDDISK_SDIO, */
+	{"harddisk-nvme.xpm", WMVM_ICON_HARDDISK},       /* WMVM_ICON_HARDDISK_NVME, */
+	{"harddisk-thunderbolt.xpm", WMVM_ICON_HARDDISK}, /* WMVM_ICON_HARDDISK_THUNDERBOLT, */
+	{"removable-sdio.xpm", WMVM_ICON_REMOVABLE},     /* WMVM_ICON_REMOVABLE_SDIO, */
+	{"removable-thunderbolt.xpm", WMVM_ICON_REMOVABLE} /* WMVM_ICON_REMOVABLE_THUNDERBOLT, */
+};
+
+/*
+ * Binary theme cache, written by "wmvolman --compile-theme".  Icons are
+ * stored as decoded XpmImage (color table and pixel indices), so loading
+ * skips XPM parsing but still allocates colors for the running display.
+ */
+#define THEME_CACHE_MAGIC	"WMVMTHM"
+#define THEME_CACHE_VERSION	1
+
+typedef struct _WMVMThemeCacheHeader {
+	char magic[8];
+	guint32 version;
+	guint32 count;
+	gint64 mtime[2];	/* user and global theme directories */
+	struct {
+		gint32 source;	/* icon providing the image, -1 for none */
+		guint32 offset;	/* WMVMThemeCacheImage, 0 if source != icon */
+	} icons[WMVM_ICON_MAX];
+} WMVMThemeCacheHeader;
+
+typedef struct _WMVMThemeCacheImage {
+	guint32 width, height, cpp, ncolors;
+	guint32 data;		/* offset of width * height pixels */
+	guint32 pad;
+	/* followed by ncolors * 6 NUL terminated color strings */
+} WMVMThemeCacheImage;
+
+#define XPM_COLOR_STRINGS	6
+
+static void wmvm_theme_color_strings(XpmColor *c, char ***strings)
+{
+	strings[0] = &c->string;
+	strings[1] = &c->symbolic;
+	strings[2] = &c->m_color;
+	strings[3] = &c->g4_color;
+	strings[4] = &c->g_color;
+	strings[5] = &c->c_color;
+}
+
+static gchar *theme_name = NULL;
+static gchar *theme_dirs[2] = { NULL, NULL };
+static GMappedFile *theme_cache = NULL;
+
+static gint64 wmvm_theme_dir_mtime(const gchar *dir)
+{
+	struct stat st;
+
+	if (dir == NULL || stat(dir, &st) != 0)
+		return 0;
+
+	return (gint64) st.st_mtime;
+}
+
+static gchar *wmvm_theme_cache_file(void)
+{
+	gchar *name, *file;
+
+	name = g_strdup_printf("%s.cache", theme_name);
+	file = g_build_filename(g_get_user_cache_dir(), "wmvolman", name, NULL);
+	g_free(name);
+
+	return file;
+}
+
+static const WMVMThemeCacheHeader *wmvm_theme_cache_header(void)
+{
+	return theme_cache ? (const WMVMThemeCacheHeader *) g_mapped_file_get_contents(theme_cache) : NULL;
+}
+
+/* Limits for cached images, anything beyond is a corrupt cache */
+#define THEME_CACHE_MAX_SIZE	1024
+#define THEME_CACHE_MAX_CPP		8
+#define THEME_CACHE_MAX_COLORS	4096
+
+/* Image at given offset, with its color strings and pixel indices in range */
+static gboolean wmvm_theme_check_image(const gchar *base, gsize len, guint32 offset)
+{
+	const WMVMThemeCacheImage *img;
+	const unsigned int *data;
+	const gchar *p, *end;
+	guint64 i, npixels;
+
+	if (offset == 0 || offset % 4 || offset > len || sizeof(*img) > len - offset)
+		return FALSE;
+
+	img = (const WMVMThemeCacheImage *) (base + offset);
+	if (img->width == 0 || img->width > THEME_CACHE_MAX_SIZE ||
+		img->height == 0 || img->height > THEME_CACHE_MAX_SIZE ||
+		img->cpp == 0 || img->cpp > THEME_CACHE_MAX_CPP ||
+		img->ncolors == 0 || img->ncolors > THEME_CACHE_MAX_COLORS)
+		return FALSE;
+
+	npixels = (guint64) img->width * img->height;
+	if (img->data % 4 || img->data < offset + sizeof(*img) || img->data > len ||
+		npixels * sizeof(unsigned int) > len - img->data)
+		return FALSE;
+
+	p = (const gchar *) (img + 1);
+	end = base + img->data;
+	for (i = 0; i < (guint64) img->ncolors * XPM_COLOR_STRINGS; i++) {
+		const gchar *nul;
+
+		if (p >= end || (nul = memchr(p, '\0', end - p)) == NULL)
+			return FALSE;
+		p = nul + 1;
+	}
+
+	data = (const unsigned int *) (base + img->data);
+	for (i = 0; i < npixels; i++)
+		if (data[i] >= img->ncolors)
+			return FALSE;
+
+	return TRUE;
+}
+
+static void wmvm_theme_open_cache(void)
+{
+	const WMVMThemeCacheHeader *hdr;
+	gchar *file;
+	int i;
+
+	file = wmvm_theme_cache_file();
+	theme_cache = g_mapped_file_new(file, FALSE, NULL);
+	g_free(file);
+
+	if (theme_cache == NULL)
+		return;
+
+	hdr = wmvm_theme_cache_header();
+
+	if (g_mapped_file_get_length(theme_cache) < sizeof(*hdr) ||
+		memcmp(hdr->magic, THEME_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+		hdr->version != THEME_CACHE_VERSION ||
+		hdr->count != WMVM_ICON_MAX)
+		goto stale;
+
+	/* Any change to theme directory invalidates the cache */
+	for (i = 0; i < 2; i++)
+		if (hdr->mtime[i] != wmvm_theme_dir_mtime(theme_dirs[i]))
+			goto stale;
+
+	/* Sources must resolve in one step, images are checked once here */
+	for (i = 0; i < WMVM_ICON_MAX; i++) {
+		gint32 source = hdr->icons[i].source;
+
+		if (source == -1)
+			continue;
+		if (source < 0 || source >= WMVM_ICON_MAX || hdr->icons[source].source != source)
+			goto corrupt;
+		if (source == i && !wmvm_theme_check_image(g_mapped_file_get_contents(theme_cache),
+												   g_mapped_file_get_length(theme_cache),
+												   hdr->icons[i].offset))
+			goto corrupt;
+	}
+
+	return;
+
+corrupt:
+	g_warning("theme cache for \"%s\" is corrupt, using XPM files", theme_name);
+	g_mapped_file_unref(theme_cache);
+	theme_cache = NULL;
+	return;
+
+stale:
+	g_debug("theme cache for \"%s\" is stale, using XPM files", theme_name);
+	g_mapped_file_unref(theme_cache);
+	theme_cache = NULL;
+}
+
+void wmvm_theme_init(const char *theme)
+{
+	const gchar *home = g_getenv("HOME");
+
+	if (NULL == theme || 0 == theme[0])
+		theme = "default";
+
+	theme_name = g_strdup(theme);
+
+	if (home && *home)
+		theme_dirs[0] = g_build_filename(home, ".wmvolman", theme, NULL);
+	theme_dirs[1] = g_build_filename(WMVM_ICONS_DIR, theme, NULL);
+
+	wmvm_theme_open_cache();
+}
+
+static gchar *wmvm_theme_find_file(int icon)
+{
+	int j;
+	gchar *file;
+
+	for (j = 0; j < 2; j++) {
+		if (theme_dirs[j] == NULL)
+			continue;
+
+		file = g_build_filename(theme_dirs[j], wmvm_device_icon_names[icon].name, NULL);
+		if (g_file_test(file, G_FILE_TEST_EXISTS))
+			return file;
+		g_free(file);
+	}
+
+	return NULL;
+}
+
+/* Returns icon whose image is used for this icon, following fallbacks */
+int wmvm_theme_resolve(int icon)
+{
+	const WMVMThemeCacheHeader *hdr;
+	gchar *file;
+
+	if ((hdr = wmvm_theme_cache_header()) != NULL)
+		return hdr->icons[icon].source;
+
+	if ((file = wmvm_theme_find_file(icon)) != NULL) {
+		g_free(file);
+		return icon;
+	}
+
+	if (wmvm_device_icon_names[icon].fallback != -1)
+		return wmvm_theme_resolve(wmvm_device_icon_names[icon].fallback);
+
+	return -1;
+}
+
+static DAShapedPixmap *wmvm_theme_load_cached_icon(int icon)
+{
+	const gchar *base, *p, *end;
+	const WMVMThemeCacheImage *img;
+	XpmImage image;
+	XpmAttributes attrs;
+	DAShapedPixmap *pix = NULL;
+	guint32 offset;
+	int i, j;
+
+	/* Checked by wmvm_theme_open_cache() */
+	base = g_mapped_file_get_contents(theme_cache);
+	offset = wmvm_theme_cache_header()->icons[icon].offset;
+
+	if (wmvm_theme_cache_header()->icons[icon].source != icon)
+		return NULL;
+
+	img = (const WMVMThemeCacheImage *) (base + offset);
+
+	image.width = img->width;
+	image.height = img->height;
+	image.cpp = img->cpp;
+	image.ncolors = img->ncolors;
+	image.data = (unsigned int *) (base + img->data);
+	image.colorTable = g_new0(XpmColor, img->ncolors);
+
+	p = (const gchar *) (img + 1);
+	end = base + img->data;
+	for (i = 0; i < img->ncolors; i++) {
+		char **color[XPM_COLOR_STRINGS];
+
+		wmvm_theme_color_strings(&image.colorTable[i], color);
+
+		for (j = 0; j < XPM_COLOR_STRINGS; j++) {
+			const gchar *nul;
+
+			if (p >= end || (nul = memchr(p, '\0', end - p)) == NULL)
+				goto out;
+
+			*color[j] = *p ? (char *) p : NULL;
+			p = nul + 1;
+		}
+	}
+
+	attrs.valuemask = XpmCloseness;
+	attrs.closeness = 40000;
+
+	if ((pix = DAMakeShapedPixmap()) == NULL)
+		goto out;
+
+	if (XpmCreatePixmapFromXpmImage(DADisplay, DAWindow, &image,
+									&pix->pixmap, &pix->shape, &attrs) != XpmSuccess) {
+		free(pix);
+		pix = NULL;
+		goto out;
+	}
+
+	pix->drawGC = DAGC;
+	pix->clearGC = DAClearGC;
+	pix->geometry.x = 0;
+	pix->geometry.y = 0;
+	pix->geometry.width = image.width;
+	pix->geometry.height = image.height;
+
+out:
+	g_free(image.colorTable);
+	return pix;
+}
+
+DAShapedPixmap *wmvm_theme_load_icon(int icon)
+{
+	DAShapedPixmap *pix = NULL;
+	gchar *file;
+	gint64 start = g_get_monotonic_time();
+
+	if (theme_cache) {
+		pix = wmvm_theme_load_cached_icon(icon);
+	} else if ((file = wmvm_theme_find_file(icon)) != NULL) {
+		pix = DAMakeShapedPixmapFromFile(file);
+		g_free(file);
+	}
+
+	g_debug("loaded %s from %s in %" G_GINT64_FORMAT " us", wmvm_device_icon_names[icon].name,
+			theme_cache ? "cache" : "XPM", g_get_monotonic_time() - start);
+
+	return pix;
+}
+
+static void wmvm_theme_append_image(GString *out, XpmImage *image)
+{
+	WMVMThemeCacheImage img;
+	gsize start = out->len;
+	int i, j;
+
+	memset(&img, 0, sizeof(img));
+	img.width = image->width;
+	img.height = image->height;
+	img.cpp = image->cpp;
+	img.ncolors = image->ncolors;
+	g_string_append_len(out, (const gchar *) &img, sizeof(img));
+
+	for (i = 0; i < image->ncolors; i++) {
+		char **color[XPM_COLOR_STRINGS];
+
+		wmvm_theme_color_strings(&image->colorTable[i], color);
+
+		for (j = 0; j < XPM_COLOR_STRINGS; j++) {
+			if (*color[j])
+				g_string_append(out, *color[j]);
+			g_string_append_c(out, '\0');
+		}
+	}
+
+	while (out->len % 4)
+		g_string_append_c(out, '\0');
+
+	img.data = out->len;
+	memcpy(out->str + start, &img, sizeof(img));
+
+	g_string_append_len(out, (const gchar *) image->data,
+						(gssize) image->width * image->height * sizeof(unsigned int));
+}
+
+gboolean wmvm_theme_compile(void)
+{
+	WMVMThemeCacheHeader hdr;
+	GString *out;
+	GError *error = NULL;
+	gchar *file, *dir;
+	int i, images = 0;
+	gboolean ret;
+
+	/* Resolve fallbacks from files, not from previous cache */
+	if (theme_cache) {
+		g_mapped_file_unref(theme_cache);
+		theme_cache = NULL;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, THEME_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = THEME_CACHE_VERSION;
+	hdr.count = WMVM_ICON_MAX;
+	for (i = 0; i < 2; i++)
+		hdr.mtime[i] = wmvm_theme_dir_mtime(theme_dirs[i]);
+
+	out = g_string_new(NULL);
+	g_string_append_len(out, (const gchar *) &hdr, sizeof(hdr));
+
+	for (i = WMVM_ICON_UNKNOWN; i < WMVM_ICON_MAX; i++) {
+		XpmImage image;
+
+		hdr.icons[i].source = wmvm_theme_resolve(i);
+
+		if (hdr.icons[i].source != i)
+			continue;
+
+		file = wmvm_theme_find_file(i);
+		if (XpmReadFileToXpmImage(file, &image, NULL) != XpmSuccess) {
+			fprintf(stderr, "%s: can not read icon\n", file);
+			hdr.icons[i].source = -1;
+			g_free(file);
+			continue;
+		}
+		g_free(file);
+
+		hdr.icons[i].offset = out->len;
+		wmvm_theme_append_image(out, &image);
+		XpmFreeXpmImage(&image);
+		images++;
+	}
+
+	/* Icons falling back to unreadable ones */
+	for (i = WMVM_ICON_UNKNOWN; i < WMVM_ICON_MAX; i++)
+		if (hdr.icons[i].source != -1 && hdr.icons[hdr.icons[i].source].source == -1)
+			hdr.icons[i].source = -1;
+
+	memcpy(out->str, &hdr, sizeof(hdr));
+
+	file = wmvm_theme_cache_file();
+	dir = g_path_get_dirname(file);
+	g_mkdir_with_parents(dir, 0755);
+	g_free(dir);
+
+	ret = g_file_set_contents(file, out->str, out->len, &error);
+	if (ret) {
+		printf("%s: %d icons, %" G_GSIZE_FORMAT " bytes\n", file, images, out->len);
+	} else {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+	}
+
+	g_free(file);
+	g_string_free(out, TRUE);
+
+	return ret;
+}
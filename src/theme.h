@@ -0,0 +1,33 @@
+/*
+ * theme.h - Window Maker Volume Manager, icon themes
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __WMVM_THEME_H__
+#define __WMVM_THEME_H__
+
+#include <glib.h>
+#include <dockapp.h>
+
+void wmvm_theme_init(const char *theme);
+int wmvm_theme_resolve(int icon);
+DAShapedPixmap *wmvm_theme_load_icon(int icon);
+gboolean wmvm_theme_compile(void);
+
+#endif
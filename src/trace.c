@@ -0,0 +1,410 @@
+/*
+ * trace.c - Window Maker Volume Manager, UDisks signal traces
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <udisks/udisks.h>
+
+#include "trace.h"
+#include "udisks.h"
+
+/*
+ * A trace is a text file with one GVariant per line:
+ *
+ *   (timestamp, event, object path, {interface: {property: value}}, invalidated)
+ *
+ * Object additions carry every interface with all its properties, so a
+ * replay can rebuild objects without udisksd.
+ */
+#define TRACE_HEADER	"# wmvolman trace 1\n"
+#define TRACE_TYPE		"(xssa{sa{sv}}as)"
+
+static const char *wmvm_trace_events[WMVM_TRACE_MAX] = {
+	"object-added",			/* WMVM_TRACE_OBJECT_ADDED */
+	"object-removed",		/* WMVM_TRACE_OBJECT_REMOVED */
+	"interface-added",		/* WMVM_TRACE_INTERFACE_ADDED */
+	"interface-removed",	/* WMVM_TRACE_INTERFACE_REMOVED */
+	"properties-changed"	/* WMVM_TRACE_PROPERTIES_CHANGED */
+};
+
+static FILE *trace_file = NULL;
+
+gboolean wmvm_trace_record_start(const char *filename)
+{
+	if ((trace_file = fopen(filename, "w")) == NULL) {
+		perror(filename);
+		return FALSE;
+	}
+
+	fputs(TRACE_HEADER, trace_file);
+
+	return TRUE;
+}
+
+gboolean wmvm_trace_recording(void)
+{
+	return trace_file != NULL;
+}
+
+static void _add_interface(GVariantBuilder *builder, GDBusProxy *proxy)
+{
+	gchar **names, **n;
+
+	g_variant_builder_open(builder, G_VARIANT_TYPE("{sa{sv}}"));
+	g_variant_builder_add(builder, "s", g_dbus_proxy_get_interface_name(proxy));
+	g_variant_builder_open(builder, G_VARIANT_TYPE_VARDICT);
+
+	if ((names = g_dbus_proxy_get_cached_property_names(proxy)) != NULL) {
+		for (n = names; *n != NULL; n++) {
+			GVariant *value;
+
+			if ((value = g_dbus_proxy_get_cached_property(proxy, *n)) != NULL) {
+				g_variant_builder_add(builder, "{sv}", *n, value);
+				g_variant_unref(value);
+			}
+		}
+		g_strfreev(names);
+	}
+
+	g_variant_builder_close(builder);
+	g_variant_builder_close(builder);
+}
+
+void wmvm_trace_record(WMVMTraceEvent event, GDBusObject *object, const gchar *interface_name,
+					   GVariant *changed_properties, const gchar *const *invalidated_properties)
+{
+	static const gchar *none[] = { NULL };
+	GVariantBuilder builder;
+	GVariant *record;
+	gchar *text;
+
+	if (trace_file == NULL)
+		return;
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sa{sv}}"));
+
+	if (event == WMVM_TRACE_OBJECT_ADDED || event == WMVM_TRACE_INTERFACE_ADDED) {
+		GList *interfaces, *l;
+
+		interfaces = g_dbus_object_get_interfaces(object);
+		for (l = interfaces; l != NULL; l = g_list_next(l)) {
+			GDBusProxy *proxy = G_DBUS_PROXY(l->data);
+
+			if (interface_name == NULL || strcmp(g_dbus_proxy_get_interface_name(proxy), interface_name) == 0)
+				_add_interface(&builder, proxy);
+		}
+		g_list_foreach(interfaces, (GFunc) g_object_unref, NULL);
+		g_list_free(interfaces);
+	} else if (interface_name != NULL) {
+		g_variant_builder_add(&builder, "{s@a{sv}}", interface_name,
+							  changed_properties ? changed_properties : g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0));
+	}
+
+	record = g_variant_new("(xss@a{sa{sv}}^as)",
+						   g_get_monotonic_time(),
+						   wmvm_trace_events[event],
+						   g_dbus_object_get_object_path(object),
+						   g_variant_builder_end(&builder),
+						   invalidated_properties ? invalidated_properties : none);
+
+	text = g_variant_print(g_variant_ref_sink(record), TRUE);
+	fprintf(trace_file, "%s\n", text);
+	fflush(trace_file);
+
+	g_free(text);
+	g_variant_unref(record);
+}
+
+/*
+ * Replay builds skeleton objects from the trace and feeds every event
+ * through the same handlers as live signals.
+ */
+static const struct WMVMTraceInterface {
+	const char *name;
+	gpointer (*create)(void);
+	void (*set)(UDisksObjectSkeleton *object, gpointer interface);
+} wmvm_trace_interfaces[] = {
+	{"org.freedesktop.UDisks2.Block", (gpointer (*)(void)) udisks_block_skeleton_new,
+	 (void (*)(UDisksObjectSkeleton *, gpointer)) udisks_object_skeleton_set_block},
+	{"org.freedesktop.UDisks2.Drive", (gpointer (*)(void)) udisks_drive_skeleton_new,
+	 (void (*)(UDisksObjectSkeleton *, gpointer)) udisks_object_skeleton_set_drive},
+	{"org.freedesktop.UDisks2.Filesystem", (gpointer (*)(void)) udisks_filesystem_skeleton_new,
+	 (void (*)(UDisksObjectSkeleton *, gpointer)) udisks_object_skeleton_set_filesystem},
+	{"org.freedesktop.UDisks2.Job", (gpointer (*)(void)) udisks_job_skeleton_new,
+	 (void (*)(UDisksObjectSkeleton *, gpointer)) udisks_object_skeleton_set_job}
+};
+
+static GHashTable *replay_objects = NULL;	/* object path -> UDisksObjectSkeleton */
+static GHashTable *replay_unknown = NULL;	/* object paths already warned about */
+static gchar **replay_lines = NULL;
+static guint replay_line = 0;
+static guint replay_count = 0;
+static gboolean replay_fast = FALSE;
+static gint64 replay_start, replay_last;
+
+/* Below wmvm_render(), so the dock repaints between events as it would live */
+#define REPLAY_PRIORITY		(G_PRIORITY_DEFAULT_IDLE + 20)
+
+GDBusObject *wmvm_trace_get_object(const gchar *object_path)
+{
+	GDBusObject *object;
+
+	if (replay_objects == NULL || (object = g_hash_table_lookup(replay_objects, object_path)) == NULL)
+		return NULL;
+
+	return g_object_ref(object);
+}
+
+static const struct WMVMTraceInterface *_find_interface(const gchar *interface_name)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS(wmvm_trace_interfaces); i++)
+		if (strcmp(wmvm_trace_interfaces[i].name, interface_name) == 0)
+			return &wmvm_trace_interfaces[i];
+
+	return NULL;
+}
+
+/* D-Bus "HintSystem" is GObject "hint-system", as named by gdbus-codegen */
+static gchar *_property_name(const gchar *dbus_name)
+{
+	GString *name = g_string_new(NULL);
+	gboolean prev_lower = FALSE;
+	const gchar *c;
+
+	for (c = dbus_name; *c; c++) {
+		if (g_ascii_isupper(*c) && prev_lower)
+			g_string_append_c(name, '-');
+		prev_lower = !g_ascii_isupper(*c);
+		g_string_append_c(name, g_ascii_tolower(*c));
+	}
+
+	return g_string_free(name, FALSE);
+}
+
+static void _set_properties(GObject *interface, GVariant *properties)
+{
+	GVariantIter iter;
+	const gchar *property;
+	GVariant *value;
+
+	g_variant_iter_init(&iter, properties);
+	while (g_variant_iter_next(&iter, "{&sv}", &property, &value)) {
+		gchar *name = _property_name(property);
+		GParamSpec *pspec;
+		GValue gvalue = G_VALUE_INIT;
+
+		if ((pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(interface), name)) != NULL) {
+			g_dbus_gvariant_to_gvalue(value, &gvalue);
+			if (g_value_type_transformable(G_VALUE_TYPE(&gvalue), pspec->value_type))
+				g_object_set_property(interface, name, &gvalue);
+			g_value_unset(&gvalue);
+		}
+
+		g_free(name);
+		g_variant_unref(value);
+	}
+}
+
+static void _add_interfaces(UDisksObjectSkeleton *object, GVariant *interfaces)
+{
+	GVariantIter iter;
+	const gchar *interface_name;
+	GVariant *properties;
+
+	g_variant_iter_init(&iter, interfaces);
+	while (g_variant_iter_next(&iter, "{&s@a{sv}}", &interface_name, &properties)) {
+		const struct WMVMTraceInterface *ti;
+
+		if ((ti = _find_interface(interface_name)) != NULL) {
+			gpointer interface = ti->create();
+
+			_set_properties(G_OBJECT(interface), properties);
+			ti->set(object, interface);
+			g_object_unref(interface);
+		}
+
+		g_variant_unref(properties);
+	}
+}
+
+static void _replay_record(GVariant *record)
+{
+	const gchar *event_name, *object_path, *interface_name = NULL;
+	GVariant *interfaces, *properties = NULL;
+	const gchar **invalidated;
+	GDBusObject *object;
+	GVariantIter iter;
+	int event;
+
+	g_variant_get(record, "(x&s&s@a{sa{sv}}^a&s)", NULL, &event_name, &object_path, &interfaces, &invalidated);
+
+	for (event = 0; event < WMVM_TRACE_MAX; event++)
+		if (strcmp(wmvm_trace_events[event], event_name) == 0)
+			break;
+
+	g_variant_iter_init(&iter, interfaces);
+	g_variant_iter_next(&iter, "{&s@a{sv}}", &interface_name, &properties);
+
+	object = g_hash_table_lookup(replay_objects, object_path);
+
+	/* Trace started after the object appeared and has no snapshot of it */
+	if (object == NULL && event != WMVM_TRACE_OBJECT_ADDED && event < WMVM_TRACE_MAX &&
+		!g_hash_table_contains(replay_unknown, object_path)) {
+		g_warning("trace line %u: %s for unknown object %s, ignored",
+				  replay_line + 1, event_name, object_path);
+		g_hash_table_add(replay_unknown, g_strdup(object_path));
+	}
+
+	switch (event) {
+	case WMVM_TRACE_OBJECT_ADDED:
+		if (object == NULL) {
+			object = G_DBUS_OBJECT(udisks_object_skeleton_new(object_path));
+			g_hash_table_insert(replay_objects, g_strdup(object_path), object);
+		}
+		_add_interfaces(UDISKS_OBJECT_SKELETON(object), interfaces);
+		wmvm_udisks_replay_event(event, object, NULL, NULL, NULL);
+		break;
+	case WMVM_TRACE_OBJECT_REMOVED:
+		if (object == NULL)
+			break;
+		g_object_ref(object);
+		g_hash_table_remove(replay_objects, object_path);
+		wmvm_udisks_replay_event(event, object, NULL, NULL, NULL);
+		g_object_unref(object);
+		break;
+	case WMVM_TRACE_INTERFACE_ADDED:
+		if (object == NULL || interface_name == NULL)
+			break;
+		_add_interfaces(UDISKS_OBJECT_SKELETON(object), interfaces);
+		wmvm_udisks_replay_event(event, object, interface_name, NULL, NULL);
+		break;
+	case WMVM_TRACE_INTERFACE_REMOVED:
+		if (object == NULL || interface_name == NULL || _find_interface(interface_name) == NULL)
+			break;
+		_find_interface(interface_name)->set(UDISKS_OBJECT_SKELETON(object), NULL);
+		wmvm_udisks_replay_event(event, object, interface_name, NULL, NULL);
+		break;
+	case WMVM_TRACE_PROPERTIES_CHANGED:
+		if (object == NULL || interface_name == NULL)
+			break;
+		{
+			GDBusInterface *interface;
+
+			if ((interface = g_dbus_object_get_interface(object, interface_name)) != NULL) {
+				_set_properties(G_OBJECT(interface), properties);
+				g_object_unref(interface);
+			}
+		}
+		wmvm_udisks_replay_event(event, object, interface_name, properties, invalidated);
+		break;
+	default:
+		g_debug("unknown trace event \"%s\"", event_name);
+		break;
+	}
+
+	if (properties)
+		g_variant_unref(properties);
+	g_variant_unref(interfaces);
+	g_free(invalidated);
+
+	replay_count++;
+}
+
+static gboolean _replay_next(gpointer user_data)
+{
+	for (; replay_lines[replay_line] != NULL; replay_line++) {
+		const gchar *line = replay_lines[replay_line];
+		GVariant *record;
+		GError *error = NULL;
+		gint64 timestamp;
+
+		if (*line == '\0' || *line == '#')
+			continue;
+
+		if ((record = g_variant_parse(G_VARIANT_TYPE(TRACE_TYPE), line, NULL, NULL, &error)) == NULL) {
+			fprintf(stderr, "trace line %u: %s\n", replay_line + 1, error->message);
+			g_error_free(error);
+			continue;
+		}
+
+		/* Keep original spacing of events, unless asked to hurry */
+		g_variant_get_child(record, 0, "x", &timestamp);
+		if (!replay_fast && replay_last != 0 && timestamp > replay_last && user_data == NULL) {
+			g_timeout_add_full(REPLAY_PRIORITY, (timestamp - replay_last) / 1000,
+							   _replay_next, GINT_TO_POINTER(1), NULL);
+			g_variant_unref(record);
+			return FALSE;
+		}
+		replay_last = timestamp;
+
+		_replay_record(record);
+		g_variant_unref(record);
+		replay_line++;
+
+		/* One event per main loop iteration, like signals from the bus */
+		if (replay_fast)
+			return TRUE;
+
+		g_idle_add_full(REPLAY_PRIORITY, _replay_next, NULL, NULL);
+		return FALSE;
+	}
+
+	g_message("replayed %u events in %" G_GINT64_FORMAT " us",
+			  replay_count, g_get_monotonic_time() - replay_start);
+
+	g_strfreev(replay_lines);
+	replay_lines = NULL;
+
+	return FALSE;
+}
+
+gboolean wmvm_trace_replay(const char *filename, gboolean fast)
+{
+	gchar *contents;
+	GError *error = NULL;
+
+	if (!g_file_get_contents(filename, &contents, NULL, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	replay_lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+
+	replay_objects = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+	replay_unknown = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	replay_fast = fast;
+	replay_start = g_get_monotonic_time();
+
+	wmvm_udisks_replay_start();
+	g_idle_add_full(REPLAY_PRIORITY, _replay_next, NULL, NULL);
+
+	return TRUE;
+}
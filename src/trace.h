@@ -0,0 +1,45 @@
+/*
+ * trace.h - Window Maker Volume Manager, UDisks signal traces
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __WMVM_TRACE_H__
+#define __WMVM_TRACE_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+
+typedef enum {
+	WMVM_TRACE_OBJECT_ADDED = 0,
+	WMVM_TRACE_OBJECT_REMOVED,
+	WMVM_TRACE_INTERFACE_ADDED,
+	WMVM_TRACE_INTERFACE_REMOVED,
+	WMVM_TRACE_PROPERTIES_CHANGED,
+	WMVM_TRACE_MAX
+} WMVMTraceEvent;
+
+gboolean wmvm_trace_record_start(const char *filename);
+gboolean wmvm_trace_recording(void);
+void wmvm_trace_record(WMVMTraceEvent event, GDBusObject *object, const gchar *interface_name,
+					   GVariant *changed_properties, const gchar *const *invalidated_properties);
+
+gboolean wmvm_trace_replay(const char *filename, gboolean fast);
+GDBusObject *wmvm_trace_get_object(const gchar *object_path);
+
+#endif
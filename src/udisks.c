@@ -30,23 +30,245 @@
 #include <udisks/udisks.h>
 
 #include "udisks.h"
+#include "rules.h"
+#include "model.h"
+#include "settings.h"
+#include "stats.h"
 #include "ui.h"
 
 static UDisksClient *udisks_client = NULL;
 
+/* Objects come from a trace instead of udisksd */
+static gboolean replaying = FALSE;
+
+static UDisksObject *_get_object(const gchar *object_path)
+{
+	if (replaying)
+		return UDISKS_OBJECT(wmvm_trace_get_object(object_path));
+
+	return udisks_client_get_object(udisks_client, object_path);
+}
+
+/* What a property change affects */
+#define CHANGED_MOUNT	(1 << 0)	/* mount status only */
+#define CHANGED_MEDIA	(1 << 1)	/* icon only */
+#define CHANGED_ALL		(1 << 2)	/* everything, run full _update_object() */
+
+typedef struct _WMVMDirtyObject {
+	guint signals;
+	guint changed;			/* CHANGED_* for the object itself */
+	guint drive_changed;	/* CHANGED_* for blocks of this drive */
+} WMVMDirtyObject;
+
+static const struct WMVMPropertyRule {
+	const char *interface;
+	const char *property;
+	guint changed;
+	gboolean drive;
+} wmvm_property_rules[] = {
+	{"org.freedesktop.UDisks2.Block", "Device", CHANGED_ALL, FALSE},
+	{"org.freedesktop.UDisks2.Block", "Drive", CHANGED_ALL, FALSE},
+	{"org.freedesktop.UDisks2.Block", "IdUsage", CHANGED_ALL, FALSE},
+	{"org.freedesktop.UDisks2.Block", "HintSystem", CHANGED_ALL, FALSE},
+	{"org.freedesktop.UDisks2.Block", "HintIgnore", CHANGED_ALL, FALSE},
+	{"org.freedesktop.UDisks2.Filesystem", "MountPoints", CHANGED_MOUNT, FALSE},
+	{"org.freedesktop.UDisks2.Job", "Objects", CHANGED_ALL, FALSE},
+	{"org.freedesktop.UDisks2.Drive", "Media", CHANGED_MEDIA, TRUE},
+	{"org.freedesktop.UDisks2.Drive", "OpticalNumAudioTracks", CHANGED_MEDIA, TRUE},
+	{"org.freedesktop.UDisks2.Drive", "MediaAvailable", CHANGED_ALL, TRUE},
+	{"org.freedesktop.UDisks2.Drive", "Optical", CHANGED_ALL, TRUE},
+	{"org.freedesktop.UDisks2.Drive", "Removable", CHANGED_MEDIA, TRUE},
+	{"org.freedesktop.UDisks2.Drive", "ConnectionBus", CHANGED_MEDIA, TRUE}
+};
+
+/* Objects with pending property changes: object path -> WMVMDirtyObject */
+static GHashTable *dirty_objects = NULL;
+static guint dirty_flush_id = 0;
+static gint64 dirty_since = 0;	/* first signal of pending flush */
+static guint64 dirty_flushes = 0, dirty_signals = 0;
+
+/* Initial enumeration or resync in progress, see _enumerate_objects() */
+static GList *pending_objects = NULL;
+static guint enumerate_id = 0;
+
+/*
+ * Running jobs: job object path -> objects it affects, and
+ * object path -> number of running jobs affecting it.
+ */
+static GHashTable *job_objects = NULL;
+static GHashTable *busy_objects = NULL;
+
+static gboolean _object_is_busy(const gchar *object_path)
+{
+	return busy_objects != NULL && g_hash_table_lookup(busy_objects, object_path) != NULL;
+}
+
+static void _job_removed(const gchar *job_path)
+{
+	gchar **objects, **o;
+
+	if (job_objects == NULL || (objects = g_hash_table_lookup(job_objects, job_path)) == NULL)
+		return;
+
+	for (o = objects; *o; o++) {
+		guint count = GPOINTER_TO_UINT(g_hash_table_lookup(busy_objects, *o));
+
+		if (count > 1) {
+			g_hash_table_insert(busy_objects, g_strdup(*o), GUINT_TO_POINTER(count - 1));
+		} else {
+			g_hash_table_remove(busy_objects, *o);
+			wmvm_volume_set_busy(*o, FALSE);
+		}
+	}
+
+	g_hash_table_remove(job_objects, job_path);
+}
+
+static void _job_added(const gchar *job_path, UDisksJob *job)
+{
+	gchar **objects, **o;
+
+	if (job_objects == NULL) {
+		job_objects = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_strfreev);
+		busy_objects = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	}
+
+	/* Objects of a known job changed */
+	_job_removed(job_path);
+
+	objects = g_strdupv((gchar **) udisks_job_get_objects(job));
+	if (objects == NULL)
+		return;
+
+	g_hash_table_insert(job_objects, g_strdup(job_path), objects);
+
+	for (o = objects; *o; o++) {
+		guint count = GPOINTER_TO_UINT(g_hash_table_lookup(busy_objects, *o));
+
+		g_hash_table_insert(busy_objects, g_strdup(*o), GUINT_TO_POINTER(count + 1));
+		if (count == 0)
+			wmvm_volume_set_busy(*o, TRUE);
+	}
+}
+
+/*
+ * Drive ownership of a block almost never changes, and drive properties
+ * change only on media change: cache both, keyed by object path.
+ */
+typedef struct _WMVMDriveInfo {
+	gboolean optical;
+	gboolean removable;
+	gboolean media_available;
+	guint audio_tracks;
+	const gchar *media;	/* interned */
+	const gchar *bus;	/* interned */
+	int icon[2];		/* by mountable, -1 until classified */
+} WMVMDriveInfo;
+
+static GHashTable *block_drives = NULL;	/* block path -> interned drive path */
+static GHashTable *drive_infos = NULL;	/* drive path -> WMVMDriveInfo */
+
+static WMVMDriveInfo *_drive_info(const gchar *drive_path)
+{
+	WMVMDriveInfo *info;
+	UDisksObject *object;
+	UDisksDrive *drive;
+
+	if (drive_infos == NULL)
+		drive_infos = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	if ((info = g_hash_table_lookup(drive_infos, drive_path)) != NULL)
+		return info;
+
+	if ((object = _get_object(drive_path)) == NULL)
+		return NULL;
+
+	if ((drive = udisks_object_peek_drive(object)) != NULL) {
+		info = g_new0(WMVMDriveInfo, 1);
+		info->optical = udisks_drive_get_optical(drive);
+		info->removable = udisks_drive_get_removable(drive);
+		info->media_available = udisks_drive_get_media_available(drive);
+		info->audio_tracks = udisks_drive_get_optical_num_audio_tracks(drive);
+		info->media = g_intern_string(udisks_drive_get_media(drive));
+		info->bus = g_intern_string(udisks_drive_get_connection_bus(drive));
+		info->icon[0] = info->icon[1] = -1;
+
+		g_hash_table_insert(drive_infos, g_strdup(drive_path), info);
+	}
+
+	g_object_unref(object);
+
+	return info;
+}
+
+/* Interned drive path of a block, NULL if it has none */
+static const gchar *_drive_path_for_block(const gchar *block_path, UDisksBlock *block)
+{
+	const gchar *drive_path;
+
+	if (block_drives == NULL)
+		block_drives = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	if ((drive_path = g_hash_table_lookup(block_drives, block_path)) == NULL) {
+		if ((drive_path = udisks_block_get_drive(block)) == NULL)
+			return NULL;
+
+		drive_path = g_intern_string(drive_path);
+		g_hash_table_insert(block_drives, g_strdup(block_path), (gpointer) drive_path);
+	}
+
+	if (strcmp(drive_path, "/") == 0)
+		return NULL;
+
+	return drive_path;
+}
+
+static WMVMDriveInfo *_drive_info_for_block(const gchar *block_path, UDisksBlock *block)
+{
+	const gchar *drive_path;
+
+	if ((drive_path = _drive_path_for_block(block_path, block)) == NULL)
+		return NULL;
+
+	return _drive_info(drive_path);
+}
+
+static void _forget_drive_info(const gchar *object_path)
+{
+	if (block_drives != NULL)
+		g_hash_table_remove(block_drives, object_path);
+	if (drive_infos != NULL)
+		g_hash_table_remove(drive_infos, object_path);
+}
+
+/* Tracked through notify::name-owner, see _name_owner_changed() */
+static gboolean has_name_owner = FALSE;
+
+/*
+ * When udisksd exits, the manager drops its owner, emits object-removed
+ * for every proxy and only then notifies, so signal handlers must ask
+ * for the live owner to leave the volumes to the grace timer.
+ */
 static gboolean _monitor_has_name_owner(void)
 {
 	gchar *name_owner;
-	gboolean ret;
+	gboolean owned;
+
+	if (replaying)
+		return has_name_owner;
 
-	name_owner = g_dbus_object_manager_client_get_name_owner(G_DBUS_OBJECT_MANAGER_CLIENT(udisks_client_get_object_manager(udisks_client)));
-	ret = (name_owner != NULL);
+	if (udisks_client == NULL)
+		return FALSE;
+
+	name_owner = g_dbus_object_manager_client_get_name_owner(
+		G_DBUS_OBJECT_MANAGER_CLIENT(udisks_client_get_object_manager(udisks_client)));
+	owned = (name_owner != NULL);
 	g_free(name_owner);
 
-	return ret;
+	return owned;
 }
 
-static gboolean _device_should_display(UDisksBlock *block, UDisksDrive *drive)
+static gboolean _device_should_display(UDisksBlock *block, WMVMDriveInfo *drive)
 {
 	/* Do not show system devices */
 	if (udisks_block_get_hint_system(block))
@@ -56,9 +278,9 @@ static gboolean _device_should_display(UDisksBlock *block, UDisksDrive *drive)
 	if (udisks_block_get_hint_ignore(block))
 		return FALSE;
 
-	if (drive && udisks_drive_get_optical(drive)) {
+	if (drive && drive->optical) {
 		/* Do not show removable devices without media */
-		if (!udisks_drive_get_media_available(drive))
+		if (!drive->media_available)
 			return FALSE;
 	} else {
 		/* Do not show devices without filesystem */
@@ -69,7 +291,7 @@ static gboolean _device_should_display(UDisksBlock *block, UDisksDrive *drive)
 	return TRUE;
 }
 
-static gboolean _device_should_mount(UDisksBlock *block, UDisksDrive *drive)
+static gboolean _device_should_mount(UDisksBlock *block, WMVMDriveInfo *drive)
 {
 	if (g_strcmp0(udisks_block_get_id_usage(block), "filesystem") != 0)
 		return FALSE;
@@ -77,6 +299,122 @@ static gboolean _device_should_mount(UDisksBlock *block, UDisksDrive *drive)
 	return TRUE;
 }
 
+/* Sorted by media, looked up with bsearch() */
+static const struct WMVMMediaIcon {
+	const char *media;
+	enum WMVMIconName icon;
+	gboolean optical;
+} wmvm_media_icons[] = {
+	{"flash", WMVM_ICON_CARD_CF, FALSE},
+	{"flash_cf", WMVM_ICON_CARD_CF, FALSE},
+	{"flash_mmc", WMVM_ICON_CARD_SDMMC, FALSE},
+	{"flash_ms", WMVM_ICON_CARD_MS, FALSE},
+	{"flash_sd", WMVM_ICON_CARD_SDMMC, FALSE},
+	{"flash_sdhc", WMVM_ICON_CARD_SDMMC, FALSE},
+	{"flash_sm", WMVM_ICON_CARD_SM, FALSE},
+	{"optical_bd", WMVM_ICON_BD, TRUE},
+	{"optical_bd_r", WMVM_ICON_BDR, TRUE},
+	{"optical_bd_re", WMVM_ICON_BDRE, TRUE},
+	{"optical_cd", WMVM_ICON_CDROM, TRUE},
+	{"optical_cd_r", WMVM_ICON_CDR, TRUE},
+	{"optical_cd_rw", WMVM_ICON_CDRW, TRUE},
+	{"optical_dvd", WMVM_ICON_DVDROM, TRUE},
+	{"optical_dvd_plus_r", WMVM_ICON_DVDPLUSR, TRUE},
+	{"optical_dvd_plus_r_dl", WMVM_ICON_DVDPLUSR, TRUE},
+	{"optical_dvd_plus_rw", WMVM_ICON_DVDPLUSRW, TRUE},
+	{"optical_dvd_plus_rw_dl", WMVM_ICON_DVDPLUSRW, TRUE},
+	{"optical_dvd_r", WMVM_ICON_DVDR, TRUE},
+	{"optical_dvd_ram", WMVM_ICON_DVDRAM, TRUE},
+	{"optical_dvd_rw", WMVM_ICON_DVDRW, TRUE},
+	{"optical_hddvd", WMVM_ICON_HDDVD, TRUE},
+	{"optical_hddvd_r", WMVM_ICON_HDDVDR, TRUE},
+	{"optical_hddvd_rw", WMVM_ICON_HDDVDRW, TRUE}
+};
+
+/* Sorted by bus, looked up with bsearch() */
+static const struct WMVMBusIcon {
+	const char *bus;
+	enum WMVMIconName removable;
+	enum WMVMIconName harddisk;
+} wmvm_bus_icons[] = {
+	{"ieee1394", WMVM_ICON_REMOVABLE_1394, WMVM_ICON_HARDDISK_1394},
+	{"nvme", WMVM_ICON_REMOVABLE, WMVM_ICON_HARDDISK_NVME},
+	{"sdio", WMVM_ICON_REMOVABLE_SDIO, WMVM_ICON_HARDDISK_SDIO},
+	{"thunderbolt", WMVM_ICON_REMOVABLE_THUNDERBOLT, WMVM_ICON_HARDDISK_THUNDERBOLT},
+	{"usb", WMVM_ICON_REMOVABLE_USB, WMVM_ICON_HARDDISK_USB}
+};
+
+static int _compare_key(const void *key, const void *entry)
+{
+	/* Both tables start with the key string */
+	return strcmp(key, *(const char *const *) entry);
+}
+
+static int _classify_media(WMVMDriveInfo *drive, gboolean mountable)
+{
+	const struct WMVMMediaIcon *m;
+	const struct WMVMBusIcon *b;
+	int icon;
+
+	if (drive == NULL)
+		return WMVM_ICON_UNKNOWN;
+
+	mountable = !!mountable;
+	if (drive->icon[mountable] != -1)
+		return drive->icon[mountable];
+
+	if (drive->optical && mountable == FALSE && drive->audio_tracks > 0)
+		icon = WMVM_ICON_CDAUDIO;
+	else if (drive->media != NULL &&
+			 (m = bsearch(drive->media, wmvm_media_icons, G_N_ELEMENTS(wmvm_media_icons),
+						  sizeof(wmvm_media_icons[0]), _compare_key)) != NULL &&
+			 m->optical == drive->optical)
+		icon = m->icon;
+	else if (drive->optical)
+		icon = WMVM_ICON_UNKNOWN;
+	else if (drive->bus != NULL &&
+			 (b = bsearch(drive->bus, wmvm_bus_icons, G_N_ELEMENTS(wmvm_bus_icons),
+						  sizeof(wmvm_bus_icons[0]), _compare_key)) != NULL)
+		icon = drive->removable ? b->removable : b->harddisk;
+	else
+		icon = drive->removable ? WMVM_ICON_REMOVABLE : WMVM_ICON_HARDDISK;
+
+	drive->icon[mountable] = icon;
+
+	return icon;
+}
+
+static void _update_mount_status(const gchar *object_path, UDisksFilesystem *filesystem)
+{
+	const gchar *const *mountpoints = udisks_filesystem_get_mount_points(filesystem);
+
+	if (mountpoints != NULL && *mountpoints != NULL) {
+		wmvm_volume_set_mount_status(object_path, *mountpoints, TRUE);
+	} else {
+		wmvm_volume_set_mount_status(object_path, NULL, FALSE);
+	}
+}
+
+/* Reclassify the icon of an already displayed block device */
+static void _update_media(GDBusObject *object)
+{
+	const gchar *object_path;
+	UDisksBlock *block;
+	WMVMDriveInfo *drive;
+
+	object_path = g_dbus_object_get_object_path(object);
+
+	if (!wmvm_is_managed_volume(object_path))
+		return;
+
+	if ((block = udisks_object_peek_block(UDISKS_OBJECT(object))) == NULL)
+		return;
+
+	drive = _drive_info_for_block(object_path, block);
+
+	wmvm_volume_set_icon(object_path, _classify_media(drive, _device_should_mount(block, drive)));
+}
+
 static void _update_object(GDBusObject *object, gboolean is_added)
 {
 	const gchar *object_path;
@@ -86,9 +424,11 @@ static void _update_object(GDBusObject *object, gboolean is_added)
 
 	object_path = g_dbus_object_get_object_path(object);
 
+	wmvm_stat_inc(WMVM_STAT_UPDATE_OBJECT);
+
 	if ((block = udisks_object_peek_block(UDISKS_OBJECT(object))) != NULL) {
 
-		UDisksDrive *drive = NULL;
+		WMVMDriveInfo *drive;
 		const char *device;
 		int icon;
 		gboolean mountable;
@@ -99,7 +439,7 @@ static void _update_object(GDBusObject *object, gboolean is_added)
 			goto out_block;
 		}
 
-		drive = udisks_client_get_drive_for_block(udisks_client, block);
+		drive = _drive_info_for_block(object_path, block);
 
 		if (!_device_should_display(block, drive)) {
 			wmvm_remove_volume(object_path);
@@ -113,168 +453,270 @@ static void _update_object(GDBusObject *object, gboolean is_added)
 
 		mountable = _device_should_mount(block, drive);
 
-		icon = WMVM_ICON_UNKNOWN;
-
-		if (drive) {
-			const char *media = udisks_drive_get_media(drive);
-
-			if (udisks_drive_get_optical(drive)) {
-				if (mountable == FALSE && udisks_drive_get_optical_num_audio_tracks(drive) > 0) {
-					icon = WMVM_ICON_CDAUDIO;
-				} else {
-#define DISK_IS(t) g_strcmp0(media, (t)) == 0
-					if (DISK_IS("optical_cd")) {
-						icon = WMVM_ICON_CDROM;
-					} else if (DISK_IS("optical_cd_r")) {
-						icon = WMVM_ICON_CDR;
-					} else if (DISK_IS("optical_cd_rw")) {
-						icon = WMVM_ICON_CDRW;
-					} else if (DISK_IS("optical_dvd")) {
-						icon = WMVM_ICON_DVDROM;
-					} else if (DISK_IS("optical_dvd_r")) {
-						icon = WMVM_ICON_DVDR;
-					} else if (DISK_IS("optical_dvd_rw")) {
-						icon = WMVM_ICON_DVDRW;
-					} else if (DISK_IS("optical_dvd_ram")) {
-						icon = WMVM_ICON_DVDRAM;
-					} else if (DISK_IS("optical_dvd_plus_r")) {
-						icon = WMVM_ICON_DVDPLUSR;
-					} else if (DISK_IS("optical_dvd_plus_rw")) {
-						icon = WMVM_ICON_DVDPLUSRW;
-					} else if (DISK_IS("optical_dvd_plus_r_dl")) {
-						icon = WMVM_ICON_DVDPLUSR;
-					} else if (DISK_IS("optical_dvd_plus_rw_dl")) {
-						icon = WMVM_ICON_DVDPLUSRW;
-					} else if (DISK_IS("optical_bd")) {
-						icon = WMVM_ICON_BD;
-					} else if (DISK_IS("optical_bd_r")) {
-						icon = WMVM_ICON_BDR;
-					} else if (DISK_IS("optical_bd_re")) {
-						icon = WMVM_ICON_BDRE;
-					} else if (DISK_IS("optical_hddvd")) {
-						icon = WMVM_ICON_HDDVD;
-					} else if (DISK_IS("optical_hddvd_r")) {
-						icon = WMVM_ICON_HDDVDR;
-					} else if (DISK_IS("optical_hddvd_rw")) {
-						icon = WMVM_ICON_HDDVDRW;
-					}
-#undef DISK_IS
-				}
-			} else {
-#define MEDIA_IS(t) g_strcmp0(media, (t)) == 0
-				if (MEDIA_IS("flash")) {
-					icon = WMVM_ICON_CARD_CF;
-				} else if (MEDIA_IS("flash_cf")) {
-					icon = WMVM_ICON_CARD_CF;
-				} else if (MEDIA_IS("flash_ms")) {
-					icon = WMVM_ICON_CARD_MS;
-				} else if (MEDIA_IS("flash_sm")) {
-					icon = WMVM_ICON_CARD_SM;
-				} else if (MEDIA_IS("flash_sd")) {
-					icon = WMVM_ICON_CARD_SDMMC;
-				} else if (MEDIA_IS("flash_sdhc")) {
-					icon = WMVM_ICON_CARD_SDMMC;
-				} else if (MEDIA_IS("flash_mmc")) {
-					icon = WMVM_ICON_CARD_SDMMC;
-				} else {
-					const char *drive_iface = udisks_drive_get_connection_bus(drive);
-
-					if (udisks_drive_get_removable(drive)) {
-						icon = WMVM_ICON_REMOVABLE;
-
-						if (g_strcmp0(drive_iface, "usb") == 0)
-							icon = WMVM_ICON_REMOVABLE_USB;
-						else if (g_strcmp0(drive_iface, "ieee1394") == 0)
-							icon = WMVM_ICON_REMOVABLE_1394;
-						/*else if (g_strcmp0(drive_iface, "sdio") == 0)
-						  icon = WMVM_ICON_REMOVABLE_SDIO;*/
-					} else {
-						icon = WMVM_ICON_HARDDISK;
-
-						if (g_strcmp0(drive_iface, "usb") == 0)
-							icon = WMVM_ICON_HARDDISK_USB;
-						else if (g_strcmp0(drive_iface, "ieee1394") == 0)
-							icon = WMVM_ICON_HARDDISK_1394;
-						/*else if (g_strcmp0(drive_iface, "sdio") == 0)
-						  icon = WMVM_ICON_HARDDISK_SDIO;*/
-					}
-				}
-#undef MEDIA_IS
-			}
-		}
+		icon = _classify_media(drive, mountable);
 
 		wmvm_update_volume(object_path, device, icon, mountable);
 
-		busy = FALSE;
-		{
-			GList *jobs = udisks_client_get_jobs_for_object(udisks_client, UDISKS_OBJECT(object));
-
-			busy = g_list_length(jobs) > 0;
-
-			g_list_foreach(jobs, (GFunc) g_object_unref, NULL);
-			g_list_free(jobs);
-		}
+		busy = _object_is_busy(object_path);
 
 		wmvm_volume_set_busy(object_path, busy);
 
 out_block:
-		if (drive)
-			g_object_unref(drive);
+		;
 	}
 
-	if ((job = udisks_object_peek_job(UDISKS_OBJECT(object))) != NULL) {
-		const gchar *const *objects;
+	if (!is_added)
+		_job_removed(object_path);
+	else if ((job = udisks_object_peek_job(UDISKS_OBJECT(object))) != NULL)
+		_job_added(object_path, job);
 
-		for (objects = udisks_job_get_objects(job); objects && *objects; objects++)
-			wmvm_volume_set_busy(*objects, is_added);
+	if ((filesystem = udisks_object_peek_filesystem(UDISKS_OBJECT(object))) != NULL)
+		_update_mount_status(object_path, filesystem);
+
+	/* if (( = udisks_object_peek_(object)) != NULL) {
+	}*/
+
+	return;
+}
+
+static WMVMDirtyObject *_dirty_object(GHashTable *objects, const gchar *object_path)
+{
+	WMVMDirtyObject *dirty;
+
+	if ((dirty = g_hash_table_lookup(objects, object_path)) == NULL) {
+		dirty = g_new0(WMVMDirtyObject, 1);
+		g_hash_table_insert(objects, g_strdup(object_path), dirty);
+	}
+
+	return dirty;
+}
+
+/* Drive property changes affect every block device of that drive */
+static void _expand_drive_changes(GHashTable *objects)
+{
+	GHashTable *drives;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (block_drives == NULL)
+		return;
+
+	drives = g_hash_table_new(g_str_hash, g_str_equal);
+
+	g_hash_table_iter_init(&iter, objects);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		if (((WMVMDirtyObject *) value)->drive_changed)
+			g_hash_table_insert(drives, key, value);
+
+	if (g_hash_table_size(drives) == 0) {
+		g_hash_table_destroy(drives);
+		return;
+	}
+
+	g_hash_table_iter_init(&iter, block_drives);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		WMVMDirtyObject *drive;
+
+		if ((drive = g_hash_table_lookup(drives, value)) != NULL)
+			_dirty_object(objects, key)->changed |= drive->drive_changed;
 	}
 
-	if ((filesystem = udisks_object_peek_filesystem(UDISKS_OBJECT(object))) != NULL) {
-		const gchar *const *mountpoints = udisks_filesystem_get_mount_points(filesystem);
+	g_hash_table_destroy(drives);
+}
+
+static void _automount(UDisksObject *object, const gchar *object_path, gint64 since);
+
+/*
+ * Volume that becomes managed while no enumeration runs was hotplugged,
+ * volumes present at startup or after udisksd restart are never automounted.
+ */
+static void _update_added_object(GDBusObject *object, gint64 since)
+{
+	const gchar *object_path = g_dbus_object_get_object_path(object);
+	gboolean is_new = !wmvm_is_managed_volume(object_path);
+
+	_update_object(object, TRUE);
+
+	if (is_new && enumerate_id == 0 && wmvm_is_managed_volume(object_path))
+		_automount(UDISKS_OBJECT(object), object_path, since);
+}
+
+static gboolean _flush_dirty_objects(gpointer user_data)
+{
+	GHashTable *objects;
+	GHashTableIter iter;
+	gpointer key, value;
+	guint count = 0, signals = 0;
+
+	objects = dirty_objects;
+	dirty_objects = NULL;
+	dirty_flush_id = 0;
+
+	_expand_drive_changes(objects);
+
+	g_hash_table_iter_init(&iter, objects);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		WMVMDirtyObject *dirty = value;
+		UDisksObject *object;
+
+		count++;
+		signals += dirty->signals;
+
+		if (dirty->changed == 0)
+			continue;
 
-		if (mountpoints != NULL && *mountpoints != NULL) {
-			wmvm_volume_set_mount_status(object_path, *mountpoints, TRUE);
+		if ((object = _get_object(key)) == NULL)
+			continue;
+
+		if (dirty->changed & CHANGED_ALL) {
+			_update_added_object(G_DBUS_OBJECT(object), dirty_since);
 		} else {
-			wmvm_volume_set_mount_status(object_path, NULL, FALSE);
+			UDisksFilesystem *filesystem;
+
+			if (dirty->changed & CHANGED_MEDIA)
+				_update_media(G_DBUS_OBJECT(object));
+			if ((dirty->changed & CHANGED_MOUNT) &&
+				(filesystem = udisks_object_peek_filesystem(object)) != NULL)
+				_update_mount_status(key, filesystem);
 		}
+
+		g_object_unref(object);
 	}
 
-	/* if (( = udisks_object_peek_(object)) != NULL) {
-	}*/
+	g_hash_table_destroy(objects);
 
-	return;
+	wmvm_note_event(dirty_since, signals);
+
+	dirty_flushes++;
+	dirty_signals += signals;
+
+	g_debug("flushed %u objects, %u signals absorbed (%" G_GUINT64_FORMAT " signals in %" G_GUINT64_FORMAT " flushes)",
+			count, signals, dirty_signals, dirty_flushes);
+
+	return FALSE;
+}
+
+static void _property_changed(const gchar *interface_name, const gchar *property, guint *changed, guint *drive_changed)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS(wmvm_property_rules); i++) {
+		if (strcmp(wmvm_property_rules[i].property, property) == 0 &&
+			strcmp(wmvm_property_rules[i].interface, interface_name) == 0) {
+			if (wmvm_property_rules[i].drive)
+				*drive_changed |= wmvm_property_rules[i].changed;
+			else
+				*changed |= wmvm_property_rules[i].changed;
+			return;
+		}
+	}
+}
+
+static void _mark_object_dirty(const gchar *object_path, const gchar *interface_name,
+							   GVariant *changed_properties, const gchar *const *invalidated_properties)
+{
+	WMVMDirtyObject *dirty;
+	GVariantIter iter;
+	const gchar *property;
+	guint changed = 0, drive_changed = 0;
+
+	if (dirty_objects == NULL)
+		dirty_objects = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	g_variant_iter_init(&iter, changed_properties);
+	while (g_variant_iter_next(&iter, "{&sv}", &property, NULL))
+		_property_changed(interface_name, property, &changed, &drive_changed);
+
+	for (; invalidated_properties && *invalidated_properties; invalidated_properties++)
+		_property_changed(interface_name, *invalidated_properties, &changed, &drive_changed);
+
+	/* Cached drive properties or block's drive may have changed */
+	if (drive_changed || (changed & CHANGED_ALL))
+		_forget_drive_info(object_path);
+
+	dirty = _dirty_object(dirty_objects, object_path);
+	dirty->signals++;
+	dirty->changed |= changed;
+	dirty->drive_changed |= drive_changed;
+
+	if (dirty_flush_id == 0) {
+		dirty_since = g_get_monotonic_time();
+		dirty_flush_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, _flush_dirty_objects, NULL, NULL);
+	}
+}
+
+static void _forget_dirty_object(const gchar *object_path)
+{
+	if (dirty_objects != NULL)
+		g_hash_table_remove(dirty_objects, object_path);
 }
 
 static void udisks_object_added(GDBusObjectManager *manager, GDBusObject *object, gpointer user_data)
 {
+	gint64 now = g_get_monotonic_time();
+
+	wmvm_stat_inc(WMVM_STAT_OBJECT_ADDED);
+
 	if (!_monitor_has_name_owner())
 		return;
 
-	_update_object(object, TRUE);
+	if (wmvm_trace_recording())
+		wmvm_trace_record(WMVM_TRACE_OBJECT_ADDED, object, NULL, NULL, NULL);
+
+	_update_added_object(object, now);
+	wmvm_note_event(now, 1);
 }
 
 static void udisks_object_removed(GDBusObjectManager *manager, GDBusObject *object, gpointer user_data)
 {
+	gint64 now = g_get_monotonic_time();
+
+	wmvm_stat_inc(WMVM_STAT_OBJECT_REMOVED);
+
 	if (!_monitor_has_name_owner())
 		return;
 
+	if (wmvm_trace_recording())
+		wmvm_trace_record(WMVM_TRACE_OBJECT_REMOVED, object, NULL, NULL, NULL);
+
+	_forget_dirty_object(g_dbus_object_get_object_path(object));
 	_update_object(object, FALSE);
+	_forget_drive_info(g_dbus_object_get_object_path(object));
+	wmvm_note_event(now, 1);
 }
 
 static void udisks_interface_added(GDBusObjectManager *manager, GDBusObject *object, GDBusInterface *interface, gpointer user_data)
 {
+	gint64 now = g_get_monotonic_time();
+
+	wmvm_stat_inc(WMVM_STAT_INTERFACE_ADDED);
+
 	if (!_monitor_has_name_owner())
 		return;
 
-	_update_object(object, TRUE);
+	if (wmvm_trace_recording())
+		wmvm_trace_record(WMVM_TRACE_INTERFACE_ADDED, object, g_dbus_proxy_get_interface_name(G_DBUS_PROXY(interface)), NULL, NULL);
+
+	_forget_drive_info(g_dbus_object_get_object_path(object));
+	_update_added_object(object, now);
+	wmvm_note_event(now, 1);
 }
 
 static void udisks_interface_removed(GDBusObjectManager *manager, GDBusObject *object, GDBusInterface *interface, gpointer user_data)
 {
+	gint64 now = g_get_monotonic_time();
+
+	wmvm_stat_inc(WMVM_STAT_INTERFACE_REMOVED);
+
 	if (!_monitor_has_name_owner())
 		return;
 
+	if (wmvm_trace_recording())
+		wmvm_trace_record(WMVM_TRACE_INTERFACE_REMOVED, object, g_dbus_proxy_get_interface_name(G_DBUS_PROXY(interface)), NULL, NULL);
+
 	_update_object(object, FALSE);
+	_forget_drive_info(g_dbus_object_get_object_path(object));
+	wmvm_note_event(now, 1);
 }
 
 static void udisks_interface_proxy_properties_changed(GDBusObjectManagerClient *manager,
@@ -284,118 +726,822 @@ static void udisks_interface_proxy_properties_changed(GDBusObjectManagerClient *
 													  const gchar* const *invalidated_properties,
 													  gpointer user_data)
 {
-	const gchar *object_path;
-	UDisksObject *object;
+	wmvm_stat_inc(WMVM_STAT_PROPERTIES_CHANGED);
 
-	object_path = g_dbus_object_get_object_path(G_DBUS_OBJECT(object_proxy));
-	object = udisks_client_get_object(udisks_client, object_path);
+	if (wmvm_trace_recording())
+		wmvm_trace_record(WMVM_TRACE_PROPERTIES_CHANGED, G_DBUS_OBJECT(object_proxy),
+						  g_dbus_proxy_get_interface_name(interface_proxy),
+						  changed_properties, invalidated_properties);
 
-	_update_object(G_DBUS_OBJECT(object), TRUE);
+	/* Property changes come in bursts, handle them once per main loop iteration */
+	_mark_object_dirty(g_dbus_object_get_object_path(G_DBUS_OBJECT(object_proxy)),
+					   g_dbus_proxy_get_interface_name(interface_proxy),
+					   changed_properties, invalidated_properties);
+}
 
-	g_object_unref(object);
+/*
+ * Mount and unmount calls in flight, by object path.  Each one has a
+ * deadline, after which the call and any UDisks job on the volume are
+ * cancelled, so a dying device can not keep the volume busy forever.
+ */
+typedef enum {
+	WMVM_OP_MOUNT = 0,
+	WMVM_OP_UNMOUNT
+} WMVMOperationKind;
+
+/*
+ * Operations started together.  Results are kept until the last one
+ * returns, then applied to the model in one short transaction, so the
+ * dock repaints once and stays live while calls are in flight.
+ */
+typedef struct _WMVMOperationResult {
+	gchar *object_path;
+	gboolean ok;
+	const char *profile;
+} WMVMOperationResult;
+
+typedef struct _WMVMOperationBatch {
+	WMVMOperationKind kind;
+	guint pending;
+	guint failed;
+	GArray *results;	/* WMVMOperationResult */
+	void (*done)(struct _WMVMOperationBatch *batch);	/* optional, before commit */
+} WMVMOperationBatch;
+
+typedef struct _WMVMOperation {
+	WMVMOperationKind kind;
+	WMVMOperationBatch *batch;
+	gchar *object_path;
+	gchar *device;
+	gint64 started;
+	gint64 hotplug;		/* first signal of automounted volume, or 0 */
+	const char *profile;	/* mount profile applied, interned */
+	GCancellable *cancellable;
+	guint timeout_id;
+} WMVMOperation;
+
+static GHashTable *operations = NULL;
+
+static const char *wmvm_operation_names[] = {
+	"mount",	/* WMVM_OP_MOUNT */
+	"unmount"	/* WMVM_OP_UNMOUNT */
+};
+
+static void _free_operation(WMVMOperation *op)
+{
+	if (op->timeout_id != 0)
+		g_source_remove(op->timeout_id);
+	g_object_unref(op->cancellable);
+	g_free(op->object_path);
+	g_free(op->device);
+	g_free(op);
 }
 
-static void udisks_device_mount_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+static void _cancel_jobs_for(const gchar *object_path)
 {
-	GError *error;
+	GHashTableIter iter;
+	gpointer key, value;
 
-	error = NULL;
-	wmvm_volume_set_error(g_dbus_object_get_object_path(g_dbus_interface_get_object(G_DBUS_INTERFACE(source_object))),
-						  !udisks_filesystem_call_mount_finish(UDISKS_FILESYSTEM(source_object), NULL, res, &error));
+	if (job_objects == NULL)
+		return;
 
-	return;
+	g_hash_table_iter_init(&iter, job_objects);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		const gchar *const *o;
+		UDisksObject *object;
+		UDisksJob *job;
+
+		for (o = value; *o != NULL; o++)
+			if (strcmp(*o, object_path) == 0)
+				break;
+		if (*o == NULL || (object = _get_object(key)) == NULL)
+			continue;
+
+		if ((job = udisks_object_peek_job(object)) != NULL && udisks_job_get_cancelable(job))
+			udisks_job_call_cancel(job, g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0), NULL, NULL, NULL);
+
+		g_object_unref(object);
+	}
 }
 
-void udisks_device_mount(const char *object_path)
+static gboolean _operation_expired(gpointer user_data)
+{
+	WMVMOperation *op = user_data;
+
+	op->timeout_id = 0;
+	wmvm_stat_inc(WMVM_STAT_TIMER_WAKEUP);
+
+	g_warning("%s of %s timed out, cancelling", wmvm_operation_names[op->kind], op->device);
+
+	g_cancellable_cancel(op->cancellable);
+	_cancel_jobs_for(op->object_path);
+
+	return FALSE;
+}
+
+static void _apply_result(const gchar *object_path, WMVMOperationKind kind, gboolean ok, const char *profile)
+{
+	wmvm_volume_set_error(object_path, !ok);
+	if (ok && kind == WMVM_OP_MOUNT)
+		wmvm_volume_set_profile(object_path, profile);
+}
+
+static void _finish_batch(WMVMOperationBatch *batch)
+{
+	guint i;
+
+	if (batch->failed)
+		g_warning("%u volumes failed to %s", batch->failed, wmvm_operation_names[batch->kind]);
+
+	wmvm_begin_update();
+
+	for (i = 0; i < batch->results->len; i++) {
+		WMVMOperationResult *r = &g_array_index(batch->results, WMVMOperationResult, i);
+
+		_apply_result(r->object_path, batch->kind, r->ok, r->profile);
+		g_free(r->object_path);
+	}
+
+	if (batch->done != NULL)
+		batch->done(batch);
+
+	wmvm_commit_update();
+
+	g_array_free(batch->results, TRUE);
+	g_free(batch);
+}
+
+static void _operation_done(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	WMVMOperation *op = user_data;
+	GError *error = NULL;
+	gboolean ok;
+
+	if (op->kind == WMVM_OP_MOUNT)
+		ok = udisks_filesystem_call_mount_finish(UDISKS_FILESYSTEM(source_object), NULL, res, &error);
+	else
+		ok = udisks_filesystem_call_unmount_finish(UDISKS_FILESYSTEM(source_object), res, &error);
+
+	wmvm_stat_record(op->kind == WMVM_OP_MOUNT ? WMVM_HIST_MOUNT : WMVM_HIST_UNMOUNT,
+					 g_get_monotonic_time() - op->started);
+	if (ok && op->hotplug != 0)
+		wmvm_stat_record(WMVM_HIST_AUTOMOUNT, g_get_monotonic_time() - op->hotplug);
+
+	if (!ok) {
+		g_warning("Can not %s %s: %s", wmvm_operation_names[op->kind], op->device,
+				  error ? error->message : "unknown error");
+		if (error)
+			g_error_free(error);
+	}
+
+	if (op->batch != NULL) {
+		WMVMOperationResult r = { g_strdup(op->object_path), ok, op->profile };
+
+		g_array_append_val(op->batch->results, r);
+		if (!ok)
+			op->batch->failed++;
+		if (--op->batch->pending == 0)
+			_finish_batch(op->batch);
+	} else {
+		_apply_result(op->object_path, op->kind, ok, op->profile);
+	}
+
+	g_hash_table_remove(operations, op->object_path);
+}
+
+static gboolean _start_operation(const char *object_path, WMVMOperationKind kind, WMVMOperationBatch *batch)
 {
 	UDisksObject *object;
+	UDisksBlock *block;
 	UDisksFilesystem *filesystem;
+	WMVMDriveInfo *drive;
+	WMVMOperation *op;
 	GVariantBuilder builder;
 
-	object = udisks_client_get_object(udisks_client, object_path);
-	filesystem = udisks_object_peek_filesystem(UDISKS_OBJECT(object));
+	/* Trace objects have no daemon behind them */
+	if (replaying)
+		return FALSE;
+
+	if (operations == NULL)
+		operations = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) _free_operation);
+
+	/* One operation per volume at a time */
+	if (g_hash_table_lookup(operations, object_path) != NULL)
+		return FALSE;
+
+	if ((object = _get_object(object_path)) == NULL)
+		return FALSE;
+
+	if ((block = udisks_object_peek_block(object)) == NULL ||
+		(filesystem = udisks_object_peek_filesystem(object)) == NULL) {
+		g_warning("Can not %s %s: no filesystem", wmvm_operation_names[kind], object_path);
+		g_object_unref(object);
+		return FALSE;
+	}
+
+	drive = _drive_info_for_block(object_path, block);
+
+	op = g_new0(WMVMOperation, 1);
+	op->kind = kind;
+	op->batch = batch;
+	op->object_path = g_strdup(object_path);
+	op->device = g_strdup(udisks_block_get_device(block));
+	op->started = g_get_monotonic_time();
+	op->cancellable = g_cancellable_new();
+	op->timeout_id = g_timeout_add_seconds(wmvm_settings_get_timeout(drive ? drive->bus : NULL),
+										   _operation_expired, op);
+	g_hash_table_insert(operations, op->object_path, op);
+
+	/* Deadline above is the only limit, not the 25 s D-Bus default */
+	g_dbus_proxy_set_default_timeout(G_DBUS_PROXY(filesystem), G_MAXINT);
+
 	g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
 
-	udisks_filesystem_call_mount(filesystem, g_variant_builder_end(&builder), NULL, udisks_device_mount_cb, NULL);
+	if (kind == WMVM_OP_MOUNT) {
+		const char *options = NULL;
+
+		op->profile = wmvm_profile_match(drive ? drive->bus : NULL, drive ? drive->media : NULL,
+										 udisks_block_get_id_type(block), udisks_block_get_id_label(block),
+										 udisks_block_get_id_uuid(block), &options);
+		if (op->profile != NULL)
+			g_debug("mounting %s with profile %s: %s", op->device, op->profile, options ? options : "");
+		if (options != NULL && *options != '\0')
+			g_variant_builder_add(&builder, "{sv}", "options", g_variant_new_string(options));
+
+		udisks_filesystem_call_mount(filesystem, g_variant_builder_end(&builder), op->cancellable,
+									 _operation_done, op);
+	} else {
+		udisks_filesystem_call_unmount(filesystem, g_variant_builder_end(&builder), op->cancellable,
+									   _operation_done, op);
+	}
+
+	g_object_unref(object);
+
+	return TRUE;
 }
 
-static void udisks_device_unmount_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+void udisks_device_mount(const char *object_path)
 {
-	GError *error;
+	_start_operation(object_path, WMVM_OP_MOUNT, NULL);
+}
 
-	error = NULL;
-	wmvm_volume_set_error(g_dbus_object_get_object_path(g_dbus_interface_get_object(G_DBUS_INTERFACE(source_object))),
-						  !udisks_filesystem_call_unmount_finish(UDISKS_FILESYSTEM(source_object), res, &error));
+void udisks_device_unmount(const char *object_path)
+{
+	_start_operation(object_path, WMVM_OP_UNMOUNT, NULL);
+}
 
-	return;
+/* Newly inserted volume, mount it if automount rules say so */
+static void _automount(UDisksObject *object, const gchar *object_path, gint64 since)
+{
+	UDisksBlock *block;
+	UDisksFilesystem *filesystem;
+	const gchar *const *mount_points;
+	WMVMDriveInfo *drive;
+	WMVMOperation *op;
+
+	if ((block = udisks_object_peek_block(object)) == NULL ||
+		(filesystem = udisks_object_peek_filesystem(object)) == NULL)
+		return;
+
+	if ((mount_points = udisks_filesystem_get_mount_points(filesystem)) != NULL && *mount_points != NULL)
+		return;
+
+	drive = _drive_info_for_block(object_path, block);
+
+	if (!wmvm_automount_match(drive ? drive->bus : NULL, drive ? drive->media : NULL,
+							  udisks_block_get_id_type(block), udisks_block_get_id_label(block),
+							  udisks_block_get_id_uuid(block)))
+		return;
+
+	if (!_start_operation(object_path, WMVM_OP_MOUNT, NULL))
+		return;
+
+	if ((op = g_hash_table_lookup(operations, object_path)) != NULL)
+		op->hotplug = since;
 }
 
-void udisks_device_unmount(const char *object_path)
+/* All calls go out at once, dock is repainted when the last one returns */
+static void _start_batch(const char *const *object_paths, WMVMOperationKind kind,
+						 void (*done)(WMVMOperationBatch *batch))
+{
+	WMVMOperationBatch *batch;
+
+	/* Trace objects have no daemon behind them */
+	if (replaying)
+		return;
+
+	batch = g_new0(WMVMOperationBatch, 1);
+	batch->kind = kind;
+	batch->results = g_array_new(FALSE, FALSE, sizeof(WMVMOperationResult));
+	batch->done = done;
+
+	/* A volume that is busy with another operation, or has no filesystem, fails */
+	for (; *object_paths != NULL; object_paths++)
+		if (_start_operation(*object_paths, kind, batch))
+			batch->pending++;
+		else
+			batch->failed++;
+
+	if (batch->pending == 0)
+		_finish_batch(batch);
+}
+
+void udisks_device_mount_all(const char *const *object_paths)
+{
+	_start_batch(object_paths, WMVM_OP_MOUNT, NULL);
+}
+
+void udisks_device_unmount_all(const char *const *object_paths)
+{
+	_start_batch(object_paths, WMVM_OP_UNMOUNT, NULL);
+}
+
+/*
+ * Drive detach: unmount every filesystem of the drive at once, wait for
+ * requests queued to the disk to complete, then eject or power it off.
+ * Only one drive is detached at a time.
+ */
+#define DETACH_POLL		250	/* ms between in-flight checks */
+#define DETACH_SHOW		2	/* seconds the result stays on the dock */
+
+typedef struct _WMVMDetach {
+	const gchar *drive_path;	/* interned */
+	gchar *device;
+	gchar *stat_path;	/* /sys/class/block/<disk>/stat */
+	gint64 started;
+	gint64 deadline;
+	guint64 in_flight_start;
+	guint timeout_id;
+} WMVMDetach;
+
+static WMVMDetach *detach = NULL;
+
+static void _free_detach(void)
+{
+	if (detach->timeout_id != 0)
+		g_source_remove(detach->timeout_id);
+	g_free(detach->device);
+	g_free(detach->stat_path);
+	g_free(detach);
+	detach = NULL;
+}
+
+static gboolean _detach_clear(gpointer user_data)
+{
+	detach->timeout_id = 0;
+	wmvm_stat_inc(WMVM_STAT_TIMER_WAKEUP);
+
+	_free_detach();
+	wmvm_set_message(NULL);
+
+	return FALSE;
+}
+
+static void _detach_finish(gboolean ok)
+{
+	gint64 elapsed = g_get_monotonic_time() - detach->started;
+
+	if (ok) {
+		wmvm_stat_record(WMVM_HIST_DETACH, elapsed);
+		g_message("%s is safe to remove after %.1f s", detach->device, (double) elapsed / G_USEC_PER_SEC);
+	}
+
+	wmvm_set_message(ok ? "safe" : "failed");
+
+	if (detach->timeout_id != 0)
+		g_source_remove(detach->timeout_id);
+	detach->timeout_id = g_timeout_add_seconds(DETACH_SHOW, _detach_clear, NULL);
+}
+
+static void _detach_drive_done(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	GError *error = NULL;
+	gboolean ok;
+
+	if (GPOINTER_TO_INT(user_data))
+		ok = udisks_drive_call_eject_finish(UDISKS_DRIVE(source_object), res, &error);
+	else
+		ok = udisks_drive_call_power_off_finish(UDISKS_DRIVE(source_object), res, &error);
+
+	if (!ok) {
+		g_warning("Can not %s %s: %s", GPOINTER_TO_INT(user_data) ? "eject" : "power off",
+				  detach->device, error ? error->message : "unknown error");
+		if (error)
+			g_error_free(error);
+	}
+
+	_detach_finish(ok);
+}
+
+static void _detach_drive(void)
 {
 	UDisksObject *object;
-	UDisksFilesystem *filesystem;
-	GVariantBuilder builder;
+	UDisksDrive *drive;
+	gboolean eject;
+
+	if ((object = _get_object(detach->drive_path)) == NULL ||
+		(drive = udisks_object_peek_drive(object)) == NULL) {
+		if (object)
+			g_object_unref(object);
+		_detach_finish(FALSE);
+		return;
+	}
 
-	object = udisks_client_get_object(udisks_client, object_path);
-	filesystem = udisks_object_peek_filesystem(UDISKS_OBJECT(object));
-	g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+	eject = udisks_drive_get_optical(drive) || udisks_drive_get_ejectable(drive);
+
+	if (eject || udisks_drive_get_can_power_off(drive)) {
+		wmvm_set_message(eject ? "eject" : "power off");
+		if (eject)
+			udisks_drive_call_eject(drive, g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0), NULL,
+									_detach_drive_done, GINT_TO_POINTER(TRUE));
+		else
+			udisks_drive_call_power_off(drive, g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0), NULL,
+										_detach_drive_done, GINT_TO_POINTER(FALSE));
+	} else {
+		/* Nothing to switch off, flushed is as safe as it gets */
+		_detach_finish(TRUE);
+	}
+
+	g_object_unref(object);
+}
+
+/*
+ * Unmount writes the filesystem back before it returns, what is left is
+ * I/O queued to the drive.  Its in-flight count is field 9 of the disk
+ * stat file in sysfs, a partition is looked up on its parent disk.
+ */
+static gchar *_disk_stat_path(const gchar *device)
+{
+	gchar *name = g_path_get_basename(device);
+	gchar *dir = g_build_filename("/sys/class/block", name, NULL);
+	gchar *partition = g_build_filename(dir, "partition", NULL);
+	gchar *path;
+
+	if (g_file_test(partition, G_FILE_TEST_EXISTS))
+		path = g_build_filename(dir, "..", "stat", NULL);
+	else
+		path = g_build_filename(dir, "stat", NULL);
+
+	g_free(partition);
+	g_free(dir);
+	g_free(name);
+
+	return path;
+}
 
-	udisks_filesystem_call_unmount(filesystem, g_variant_builder_end(&builder), NULL, udisks_device_unmount_cb, NULL);
+static gboolean _disk_in_flight(const gchar *stat_path, guint64 *in_flight)
+{
+	gchar *contents;
+	unsigned long long n;
+	gboolean ok;
+
+	if (!g_file_get_contents(stat_path, &contents, NULL, NULL))
+		return FALSE;
+
+	ok = sscanf(contents, "%*u %*u %*u %*u %*u %*u %*u %*u %llu", &n) == 1;
+	if (ok)
+		*in_flight = n;
+
+	g_free(contents);
+
+	return ok;
+}
+
+static gboolean _detach_flush_poll(gpointer user_data)
+{
+	guint64 in_flight = 0;
+	char text[16];
+
+	wmvm_stat_inc(WMVM_STAT_TIMER_WAKEUP);
+
+	/* Without a stat file the unmount itself is all the flushing there is */
+	if (!_disk_in_flight(detach->stat_path, &in_flight) || in_flight == 0 ||
+		g_get_monotonic_time() >= detach->deadline) {
+		if (in_flight != 0)
+			g_warning("%" G_GUINT64_FORMAT " requests still in flight, detaching %s anyway",
+					  in_flight, detach->device);
+		detach->timeout_id = 0;
+		_detach_drive();
+		return FALSE;
+	}
+
+	if (in_flight > detach->in_flight_start)
+		detach->in_flight_start = in_flight;
+
+	g_snprintf(text, sizeof(text), "flush %u", (guint) (100 - in_flight * 100 / detach->in_flight_start));
+	wmvm_set_message(text);
+
+	return TRUE;
+}
+
+static void _detach_unmounted(WMVMOperationBatch *batch)
+{
+	WMVMDriveInfo *drive;
+
+	if (batch->failed) {
+		_detach_finish(FALSE);
+		return;
+	}
+
+	drive = _drive_info(detach->drive_path);
+
+	detach->in_flight_start = 0;
+	detach->deadline = g_get_monotonic_time() +
+		(gint64) wmvm_settings_get_timeout(drive ? drive->bus : NULL) * G_USEC_PER_SEC;
+
+	if (_detach_flush_poll(NULL))
+		detach->timeout_id = g_timeout_add(DETACH_POLL, _detach_flush_poll, NULL);
+}
+
+void udisks_drive_detach(const char *object_path)
+{
+	UDisksObject *object;
+	UDisksBlock *block;
+	const gchar *drive_path;
+	GHashTableIter iter;
+	gpointer key, value;
+	GPtrArray *paths;
+
+	/* Trace objects have no daemon behind them */
+	if (replaying || detach != NULL)
+		return;
+
+	if ((object = _get_object(object_path)) == NULL)
+		return;
+
+	if ((block = udisks_object_peek_block(object)) == NULL ||
+		(drive_path = _drive_path_for_block(object_path, block)) == NULL) {
+		g_warning("Can not detach %s: no drive", object_path);
+		g_object_unref(object);
+		return;
+	}
+
+	detach = g_new0(WMVMDetach, 1);
+	detach->drive_path = drive_path;
+	detach->device = g_strdup(udisks_block_get_device(block));
+	detach->stat_path = _disk_stat_path(detach->device);
+	detach->started = g_get_monotonic_time();
+
+	g_object_unref(object);
+
+	/* Every mounted filesystem on the same drive */
+	paths = g_ptr_array_new();
+	g_hash_table_iter_init(&iter, block_drives);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		UDisksFilesystem *filesystem;
+		const gchar *const *mount_points;
+
+		if (value != drive_path || (object = _get_object(key)) == NULL)
+			continue;
+
+		if ((filesystem = udisks_object_peek_filesystem(object)) != NULL &&
+			(mount_points = udisks_filesystem_get_mount_points(filesystem)) != NULL &&
+			*mount_points != NULL)
+			g_ptr_array_add(paths, key);
+
+		g_object_unref(object);
+	}
+	g_ptr_array_add(paths, NULL);
+
+	wmvm_set_message("unmount");
+	_start_batch((const char *const *) paths->pdata, WMVM_OP_UNMOUNT, _detach_unmounted);
+
+	g_ptr_array_free(paths, TRUE);
+}
+
+/* Objects left to enumerate, handled a chunk per main loop iteration */
+#define ENUMERATE_CHUNK		16
+
+static gboolean _enumerate_objects(gpointer user_data)
+{
+	GDBusObjectManager *manager = udisks_client_get_object_manager(udisks_client);
+	int i;
+
+	for (i = 0; i < ENUMERATE_CHUNK && pending_objects != NULL; i++) {
+		GDBusObject *object = pending_objects->data;
+		GDBusObject *live;
+
+		pending_objects = g_list_delete_link(pending_objects, pending_objects);
+
+		/* Skip objects removed while waiting */
+		if ((live = g_dbus_object_manager_get_object(manager, g_dbus_object_get_object_path(object))) != NULL) {
+			/* Snapshot, so replay knows objects that existed before recording */
+			if (wmvm_trace_recording())
+				wmvm_trace_record(WMVM_TRACE_OBJECT_ADDED, live, NULL, NULL, NULL);
+			_update_object(live, TRUE);
+			g_object_unref(live);
+		}
+
+		g_object_unref(object);
+	}
+
+	if (pending_objects != NULL)
+		return TRUE;
+
+	enumerate_id = 0;
+	wmvm_remove_stale_volumes();
+	wmvm_commit_update();
+	return FALSE;
+}
+
+/* Retry connection to udisksd with exponential backoff */
+#define CONNECT_DELAY_MAX	64
+
+static guint connect_delay = 0;
+
+static void init_udisks_connection(void);
+static void _name_owner_changed(GObject *object, GParamSpec *pspec, gpointer user_data);
+
+static gboolean _connect_retry(gpointer user_data)
+{
+	wmvm_stat_inc(WMVM_STAT_TIMER_WAKEUP);
+	init_udisks_connection();
+
+	return FALSE;
 }
 
-static gboolean init_udisks_connection(void)
+static void _client_ready(GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
 	GError *error;
 	GDBusObjectManager *manager;
 
 	error = NULL;
-	if (udisks_client == NULL) {
-		udisks_client = udisks_client_new_sync(NULL, &error);
-
-		manager = udisks_client_get_object_manager(udisks_client);
-
-		g_signal_connect(manager,
-						 "object-added",
-						 G_CALLBACK(udisks_object_added),
-						 NULL);
-		g_signal_connect(manager,
-						 "object-removed",
-						 G_CALLBACK(udisks_object_removed),
-						 NULL);
-		g_signal_connect(manager,
-						 "interface-added",
-						 G_CALLBACK(udisks_interface_added),
-						 NULL);
-		g_signal_connect(manager,
-						 "interface-removed",
-						 G_CALLBACK(udisks_interface_removed),
-						 NULL);
-		g_signal_connect(manager,
-						 "interface-proxy-properties-changed",
-						 G_CALLBACK(udisks_interface_proxy_properties_changed),
-						 NULL);
+	if ((udisks_client = udisks_client_new_finish(res, &error)) == NULL) {
+		connect_delay = connect_delay ? MIN(connect_delay * 2, CONNECT_DELAY_MAX) : 1;
+
+		g_warning("Can not connect to UDisks: %s, retrying in %u seconds",
+				  error ? error->message : "unknown error", connect_delay);
+		if (error)
+			g_error_free(error);
+
+		wmvm_set_status("no udisks");
+		g_timeout_add_seconds(connect_delay, _connect_retry, NULL);
+		return;
 	}
 
-	return TRUE;
+	connect_delay = 0;
+
+	manager = udisks_client_get_object_manager(udisks_client);
+
+	g_signal_connect(manager,
+					 "object-added",
+					 G_CALLBACK(udisks_object_added),
+					 NULL);
+	g_signal_connect(manager,
+					 "object-removed",
+					 G_CALLBACK(udisks_object_removed),
+					 NULL);
+	g_signal_connect(manager,
+					 "interface-added",
+					 G_CALLBACK(udisks_interface_added),
+					 NULL);
+	g_signal_connect(manager,
+					 "interface-removed",
+					 G_CALLBACK(udisks_interface_removed),
+					 NULL);
+	g_signal_connect(manager,
+					 "interface-proxy-properties-changed",
+					 G_CALLBACK(udisks_interface_proxy_properties_changed),
+					 NULL);
+
+	g_signal_connect(manager,
+					 "notify::name-owner",
+					 G_CALLBACK(_name_owner_changed),
+					 NULL);
+
+	_name_owner_changed(G_OBJECT(manager), NULL, NULL);
 }
 
-gboolean wmvm_do_udisks_init(void)
+/* Volumes are kept this long after udisksd exits, in case it is restarted */
+#define OWNER_GRACE		2
+
+static guint owner_lost_id = 0;
+
+/* Reconcile the volume list with the object tree, without tearing it down */
+static void _resync_objects(void)
+{
+	GDBusObjectManager *manager = udisks_client_get_object_manager(udisks_client);
+
+	if (enumerate_id == 0) {
+		/* Single sort, selection and repaint for the whole object tree */
+		wmvm_begin_update();
+		enumerate_id = g_idle_add(_enumerate_objects, NULL);
+	}
+
+	g_list_foreach(pending_objects, (GFunc) g_object_unref, NULL);
+	g_list_free(pending_objects);
+
+	wmvm_mark_volumes_stale();
+	pending_objects = g_dbus_object_manager_get_objects(manager);
+}
+
+static gboolean _owner_lost_timeout(gpointer user_data)
+{
+	owner_lost_id = 0;
+	wmvm_stat_inc(WMVM_STAT_TIMER_WAKEUP);
+	wmvm_remove_all_volumes();
+
+	return FALSE;
+}
+
+static void _reset_object_state(void)
+{
+	if (dirty_objects != NULL)
+		g_hash_table_remove_all(dirty_objects);
+	if (job_objects != NULL) {
+		g_hash_table_remove_all(job_objects);
+		g_hash_table_remove_all(busy_objects);
+	}
+	if (block_drives != NULL)
+		g_hash_table_remove_all(block_drives);
+	if (drive_infos != NULL)
+		g_hash_table_remove_all(drive_infos);
+}
+
+static void _name_owner_changed(GObject *object, GParamSpec *pspec, gpointer user_data)
 {
-	GList *objects;
+	gchar *name_owner;
+	gboolean owned;
+
+	name_owner = g_dbus_object_manager_client_get_name_owner(G_DBUS_OBJECT_MANAGER_CLIENT(object));
+	owned = (name_owner != NULL);
+	g_free(name_owner);
+
+	/* Initial call from _client_ready() has no pspec and always reports */
+	if (owned == has_name_owner && pspec != NULL)
+		return;
+
+	has_name_owner = owned;
+	_reset_object_state();
+
+	if (!owned) {
+		if (pspec == NULL)
+			g_warning("UDisks is not running, waiting for it to start");
+		wmvm_set_status("no udisks");
+		if (owner_lost_id == 0)
+			owner_lost_id = g_timeout_add_seconds(OWNER_GRACE, _owner_lost_timeout, NULL);
+		return;
+	}
+
+	if (owner_lost_id != 0) {
+		g_source_remove(owner_lost_id);
+		owner_lost_id = 0;
+	}
+
+	wmvm_set_status(NULL);
+	_resync_objects();
+}
+
+static void init_udisks_connection(void)
+{
+	wmvm_set_status("connecting");
+
+	udisks_client_new(NULL, _client_ready, NULL);
+}
 
+void wmvm_udisks_replay_start(void)
+{
 #if !GLIB_CHECK_VERSION(2, 35, 0)
 	g_type_init();
 #endif
 
-	if (!init_udisks_connection()) {
-		return FALSE;
+	replaying = TRUE;
+	has_name_owner = TRUE;
+}
+
+void wmvm_udisks_replay_event(WMVMTraceEvent event, GDBusObject *object, const gchar *interface_name,
+							  GVariant *changed_properties, const gchar *const *invalidated_properties)
+{
+	switch (event) {
+	case WMVM_TRACE_OBJECT_ADDED:
+		udisks_object_added(NULL, object, NULL);
+		break;
+	case WMVM_TRACE_OBJECT_REMOVED:
+		udisks_object_removed(NULL, object, NULL);
+		break;
+	case WMVM_TRACE_INTERFACE_ADDED:
+		udisks_interface_added(NULL, object, NULL, NULL);
+		break;
+	case WMVM_TRACE_INTERFACE_REMOVED:
+		udisks_interface_removed(NULL, object, NULL, NULL);
+		break;
+	case WMVM_TRACE_PROPERTIES_CHANGED:
+		_mark_object_dirty(g_dbus_object_get_object_path(object), interface_name,
+						   changed_properties, invalidated_properties);
+		break;
+	default:
+		break;
 	}
+}
 
-	objects = g_dbus_object_manager_get_objects(udisks_client_get_object_manager(udisks_client));
+gboolean wmvm_do_udisks_init(void)
+{
+#if !GLIB_CHECK_VERSION(2, 35, 0)
+	g_type_init();
+#endif
 
-	g_list_foreach(objects, (GFunc) _update_object, (gpointer) TRUE);
-	g_list_foreach(objects, (GFunc) g_object_unref, NULL);
-	g_list_free(objects);
+	if (udisks_client == NULL)
+		init_udisks_connection();
 
 	return TRUE;
 }
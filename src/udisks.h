@@ -24,8 +24,18 @@
 
 #include <glib.h>
 
+#include "trace.h"
+
 gboolean wmvm_do_udisks_init(void);
 void udisks_device_mount(const char *object_path);
 void udisks_device_unmount(const char *object_path);
+void udisks_device_mount_all(const char *const *object_paths);
+void udisks_device_unmount_all(const char *const *object_paths);
+void udisks_drive_detach(const char *object_path);
+
+/* Trace replay, see trace.c */
+void wmvm_udisks_replay_start(void);
+void wmvm_udisks_replay_event(WMVMTraceEvent event, GDBusObject *object, const gchar *interface_name,
+							  GVariant *changed_properties, const gchar *const *invalidated_properties);
 
 #endif
@@ -28,11 +28,15 @@
 #include <string.h>
 #include <glib.h>
 #include <dockapp.h>
+#include <X11/extensions/shape.h>
 
 #include <time.h>
 
 #include "ui.h"
+#include "model.h"
 #include "udisks.h"
+#include "stats.h"
+#include "theme.h"
 
 #include "wmvolman-master.xpm"
 #include "wmvolman-buttons.xpm"
@@ -46,62 +50,55 @@ static GMainLoop *loop;
 
 static Window iconWin;
 
-static DAShapedPixmap *master, *buttons, *icon_none;
-static DAShapedPixmap *wmvm_device_icons[WMVM_ICON_MAX];
-
-static struct WMVMDeviceIconDesc {
-	char *name;
-	enum WMVMIconName fallback;
-} wmvm_device_icon_names[WMVM_ICON_MAX] = {
-	{"unknown.xpm", -1},                             /* WMVM_ICON_UNKNOWN = 0, */
-	{"cdrom-unknown.xpm", WMVM_ICON_UNKNOWN},        /* WMVM_ICON_CD_UNKNOWN, */
-	{"cdrom.xpm", WMVM_ICON_CD_UNKNOWN},             /* WMVM_ICON_CDROM, */
-	{"disc-audio.xpm", WMVM_ICON_CDROM},             /* WMVM_ICON_CDAUDIO, */
-	{"disc-cdr.xpm", WMVM_ICON_CDROM},               /* WMVM_ICON_CDR, */
-	{"disc-cdrw.xpm", WMVM_ICON_CDROM},              /* WMVM_ICON_CDRW, */
-	{"disc-dvdrom.xpm", WMVM_ICON_CDROM},            /* WMVM_ICON_DVDROM, */
-	{"disc-dvdram.xpm", WMVM_ICON_DVDROM},           /* WMVM_ICON_DVDRAM, */
-	{"disc-dvdr.xpm", WMVM_ICON_DVDROM},             /* WMVM_ICON_DVDR, */
-	{"disc-dvdrw.xpm", WMVM_ICON_DVDROM},            /* WMVM_ICON_DVDRW, */
-	{"disc-dvdr-plus.xpm", WMVM_ICON_DVDROM},        /* WMVM_ICON_DVDPLUSR, */
-	{"disc-dvdrw-plus.xpm", WMVM_ICON_DVDROM},       /* WMVM_ICON_DVDPLUSRW, */
-	{"disc-bd.xpm", WMVM_ICON_CDROM},                /* WMVM_ICON_BD, */
-	{"disc-bdr.xpm", WMVM_ICON_BD},                  /* WMVM_ICON_BDR, */
-	{"disc-bdre.xpm", WMVM_ICON_BD},                 /* WMVM_ICON_BDRE, */
-	{"disc-hddvd.xpm", WMVM_ICON_CDROM},             /* WMVM_ICON_HDDVD, */
-	{"disc-hddvdr.xpm", WMVM_ICON_HDDVD},            /* WMVM_ICON_HDDVDR, */
-	{"disc-hddvdrw.xpm", WMVM_ICON_HDDVD},           /* WMVM_ICON_HDDVDRW, */
-	{"harddisk.xpm", WMVM_ICON_UNKNOWN},             /* WMVM_ICON_HARDDISK, */
-	{"harddisk-usb.xpm", WMVM_ICON_HARDDISK},        /* WMVM_ICON_HARDDISK_USB, */
-	{"harddisk-1394.xpm", WMVM_ICON_HARDDISK},       /* WMVM_ICON_HARDDISK_1394, */
-	{"removable.xpm", WMVM_ICON_HARDDISK},           /* WMVM_ICON_REMOVABLE, */
-	{"removable-usb.xpm", WMVM_ICON_HARDDISK_USB},   /* WMVM_ICON_REMOVABLE_USB, */
-	{"removable-1394.xpm", WMVM_ICON_HARDDISK_1394}, /* WMVM_ICON_REMOVABLE_1394, */
-	{"card-cf.xpm", WMVM_ICON_REMOVABLE},            /* WMVM_ICON_CARD_CF, */
-	{"card-ms.xpm", WMVM_ICON_REMOVABLE},            /* WMVM_ICON_CARD_MS, */
-	{"card-sdmmc.xpm", WMVM_ICON_REMOVABLE},         /* WMVM_ICON_CARD_SDMMC, */
-	{"card-sm.xpm", WMVM_ICON_REMOVABLE}             /* WMVM_ICON_CARD_SM, */
-};
+static DAShapedPixmap *master, *buttons;
 
-typedef struct _WMVMVolume {
-	char *udi;
-	char *device;
-	char *mountpoint;
-	char *display_name;
-	gboolean mountable;
-	DAShapedPixmap *icon;
-	gboolean mounted;
-	gboolean busy;
-	gboolean error;
-} WMVMVolume;
-
-static GList *wmvm_volumes = NULL;
-static WMVMVolume *current = NULL;
+/*
+ * Device icons are loaded on first use into slots of a single atlas
+ * pixmap and mask, fallbacks share the same slot.
+ */
+#define ICON_WIDTH	36
+#define ICON_HEIGHT	24
+#define ICON_SLOTS	(WMVM_ICON_MAX + 1)
+
+static Pixmap icon_atlas = None, icon_atlas_mask = None;
+static GC icon_mask_gc;
+static int icon_slots = 0;
+static int icon_none = -1, shown_icon = -1, shaped_icon = -1;
+static int wmvm_device_icons[WMVM_ICON_MAX];
+
+/* Per volume drawing state, hangs off WMVMVolume.view */
+typedef struct _WMVMVolumeView {
+	Pixmap strip;		/* display_name rendered once, see wmvm_make_strip() */
+	int strip_width;
+} WMVMVolumeView;
 
 static DARect icon_area = { 22, 18, 36, 24 };
 
 #define MAX_POS	8
-static int cpos = 0, dpos = 1, tpause = 2;
+#define CHAR_WIDTH	6
+#define TEXT_X		8
+#define TEXT_Y		8
+#define TEXT_WIDTH	(MAX_POS * CHAR_WIDTH)
+#define TEXT_HEIGHT	7
+
+/* Scroll position is in pixels, one character or one pixel per tick */
+static int cpos = 0, dpos = CHAR_WIDTH;
+static int scroll_step = CHAR_WIDTH;
+static guint scroll_interval = 250;
+/* Scroll or pause timer, armed only while a visible title does not fit */
+static guint scroll_id = 0;
+static gboolean visible = TRUE;
+static Pixmap blank_strip = None;
+
+/* Shown in place of volume name when there are no volumes */
+static char *status = NULL;
+static Pixmap status_strip = None;
+static int status_width;
+
+/* Progress of a drive operation, shown over everything else while set */
+static char *message = NULL;
+static Pixmap message_strip = None;
+static int message_width;
 
 typedef struct _WMVMButton {
 	DARect r;
@@ -111,6 +108,17 @@ typedef struct _WMVMButton {
 
 static int pressed = -1;
 
+/* Parts of the dock that need repainting */
+#define DIRTY_TEXT		(1 << 0)
+#define DIRTY_BUTTONS	(1 << 1)
+#define DIRTY_ICON		(1 << 2)
+#define DIRTY_MOUNT		(1 << 3)
+#define DIRTY_ALL		(DIRTY_TEXT | DIRTY_BUTTONS | DIRTY_ICON | DIRTY_MOUNT)
+
+static guint dirty = 0;
+static guint render_id = 0;
+static gint64 render_interval = 0, last_render = 0;
+
 static inline int IN_RECT(int __x, int __y, DARect *__r)
 {
 	return !((__x < __r->x) ||
@@ -131,6 +139,10 @@ static inline int IN_RECT(int __x, int __y, DARect *__r)
 static void wmvm_mountumount(void);
 static void wmvm_list_left(void);
 static void wmvm_list_right(void);
+static void wmvm_queue_render(guint what);
+static void wmvm_set_visible(gboolean v);
+static void wmvm_draw_icon(int slot);
+static gboolean wmvm_timeout(gpointer data);
 
 static WMVMButton wmvm_buttons[] = {
 	{{  5, 48, 28, 11 }, STATE_NORMAL, wmvm_mountumount},
@@ -138,35 +150,143 @@ static WMVMButton wmvm_buttons[] = {
 	{{ 46, 48, 13, 11 }, STATE_NORMAL, wmvm_list_right}
 };
 
+static unsigned long x_last_request = 0;
+
+/*
+ * X connection is read only when poll() says so and flushed once per
+ * frame, XPending() would do both on every main loop iteration.  Calls
+ * that may hit the socket are counted to keep it that way.
+ */
+
+static void wmvm_x_flush(void)
+{
+	/* Requests issued since last flush, from Xlib's sequence number */
+	wmvm_stats[WMVM_STAT_X_REQUEST] += NextRequest(DADisplay) - x_last_request;
+	x_last_request = NextRequest(DADisplay);
+
+	XFlush(DADisplay);
+	wmvm_stat_inc(WMVM_STAT_X_FLUSH);
+}
+
 static gboolean wmvm_event_prepare(GSource *src, gint *tm)
 {
 	*tm = -1;
-	if (XPending(DADisplay))
-		return TRUE;
 
-	return FALSE;
+	wmvm_stat_inc(WMVM_STAT_LOOP_ITERATION);
+
+	/* Events may have been read while waiting for a reply */
+	return XEventsQueued(DADisplay, QueuedAlready) > 0;
 }
 
 static gboolean wmvm_event_check(GSource *src)
 {
-	if (XPending(DADisplay))
-		return TRUE;
+	WMVMSource *source = (WMVMSource *) src;
 
-	return FALSE;
+	return (source->poll_fd.revents & G_IO_IN) || XEventsQueued(DADisplay, QueuedAlready) > 0;
 }
 
 static gboolean wmvm_event_dispatch(GSource *src, GSourceFunc cb, gpointer data)
 {
+	WMVMSource *source = (WMVMSource *) src;
 	XEvent evt;
+	int n;
 
-	while (XPending(DADisplay)) {
+	if (source->poll_fd.revents & G_IO_IN) {
+		n = XEventsQueued(DADisplay, QueuedAfterReading);
+		wmvm_stat_inc(WMVM_STAT_X_READ);
+	} else {
+		n = XEventsQueued(DADisplay, QueuedAlready);
+	}
+
+	/* Whatever arrives meanwhile wakes up poll() again */
+	for (; n > 0; n--) {
 		XNextEvent(DADisplay, &evt);
+
+		/* Icon window has no background, repaint it from the atlas */
+		if (evt.type == Expose && evt.xexpose.window == iconWin) {
+			if (evt.xexpose.count == 0 && shown_icon != -1)
+				wmvm_draw_icon(shown_icon);
+			continue;
+		}
+
+		/* Do not scroll text nobody can see */
+		if (evt.type == VisibilityNotify)
+			wmvm_set_visible(evt.xvisibility.state != VisibilityFullyObscured);
+		else if (evt.type == UnmapNotify)
+			wmvm_set_visible(FALSE);
+		else if (evt.type == MapNotify)
+			wmvm_set_visible(TRUE);
+
 		DAProcessEvent(&evt);
 	}
 
+	wmvm_x_flush();
+
 	return TRUE;
 }
 
+static int wmvm_atlas_add(DAShapedPixmap *pix)
+{
+	int slot = icon_slots++;
+
+	XCopyArea(DADisplay, pix->pixmap, icon_atlas, DAGC,
+			  0, 0, ICON_WIDTH, ICON_HEIGHT, 0, slot * ICON_HEIGHT);
+	if (pix->shape != None)
+		XCopyArea(DADisplay, pix->shape, icon_atlas_mask, icon_mask_gc,
+				  0, 0, ICON_WIDTH, ICON_HEIGHT, 0, slot * ICON_HEIGHT);
+	else
+		XFillRectangle(DADisplay, icon_atlas_mask, icon_mask_gc,
+					   0, slot * ICON_HEIGHT, ICON_WIDTH, ICON_HEIGHT);
+
+	/* Image lives in the atlas now */
+	XFreePixmap(DADisplay, pix->pixmap);
+	if (pix->shape != None)
+		XFreePixmap(DADisplay, pix->shape);
+	free(pix);
+
+	return slot;
+}
+
+static int wmvm_device_icon(int icon)
+{
+	DAShapedPixmap *pix;
+
+	if (icon < WMVM_ICON_UNKNOWN || icon >= WMVM_ICON_MAX)
+		icon = WMVM_ICON_UNKNOWN;
+
+	if (wmvm_device_icons[icon] == -1) {
+		int source = wmvm_theme_resolve(icon);
+		int slot;
+
+		if (source == -1)
+			slot = icon_none;
+		else if (source != icon)
+			slot = wmvm_device_icon(source);
+		else if ((pix = wmvm_theme_load_icon(icon)) != NULL)
+			slot = wmvm_atlas_add(pix);
+		else
+			slot = icon_none;
+
+		wmvm_device_icons[icon] = slot;
+	}
+
+	return wmvm_device_icons[icon];
+}
+
+/* Switching icons is a copy from the atlas and, if needed, a new shape */
+static void wmvm_draw_icon(int slot)
+{
+	if (slot != shaped_icon) {
+		XShapeCombineMask(DADisplay, iconWin, ShapeBounding,
+						  0, -slot * ICON_HEIGHT, icon_atlas_mask, ShapeSet);
+		shaped_icon = slot;
+	}
+
+	XCopyArea(DADisplay, icon_atlas, iconWin, DAGC,
+			  0, slot * ICON_HEIGHT, ICON_WIDTH, ICON_HEIGHT, 0, 0);
+	shown_icon = slot;
+}
+
 static void wmvm_draw_button(int b)
 {
 	if(b == -1)
@@ -183,15 +303,12 @@ static void wmvm_refresh_window()
 	DASPSetPixmap(master);
 }
 
-static void wmvm_draw_char(char c, int pos)
+static void wmvm_draw_char(Pixmap dst, char c, int pos)
 {
 	char *p;
 	static char *syms = "0123456789 -.\'()*/_";
 	int fromx, fromy;
 
-	if (pos >= MAX_POS)
-		return;
-
 	if (c >= 'a' && c <= 'z') {
 		fromx = (c - 'a')*6 + 1;
 		fromy = 51;
@@ -206,50 +323,162 @@ static void wmvm_draw_char(char c, int pos)
 		fromy = 61;
 	}
 
-	DASPCopyArea(buttons, master,
-				 fromx, fromy, 5, 7, 8 + pos*6, 8);
+	XCopyArea(DADisplay, buttons->pixmap, dst, DAGC,
+			  fromx, fromy, 5, 7, pos*CHAR_WIDTH, 0);
+	/* gap between characters, from the font's own blank first column */
+	XCopyArea(DADisplay, buttons->pixmap, dst, DAGC,
+			  0, 51, 1, TEXT_HEIGHT, pos*CHAR_WIDTH + 5, 0);
 }
 
-static void wmvm_draw_string(char *str)
+/* Render whole string off-screen, so scrolling is a single copy */
+static Pixmap wmvm_make_strip(const char *str, int *width)
 {
-	int i;
-	char *p;
+	Pixmap strip;
+	int i, len, n;
 
-	if (str && strlen(str) > cpos) {
-		for (i = 0, p = str + cpos; i < MAX_POS && *p; i++, p++)
-			wmvm_draw_char(*p, i);
-		for (; i < MAX_POS; i++)
-			wmvm_draw_char(' ', i);
-	} else {
-		for (i = 0; i < MAX_POS; i++)
-			wmvm_draw_char(' ', i);
+	len = str ? strlen(str) : 0;
+	n = MAX(len, MAX_POS);
+
+	*width = n * CHAR_WIDTH;
+	strip = XCreatePixmap(DADisplay, DAWindow, *width, TEXT_HEIGHT, DADepth);
+
+	for (i = 0; i < n; i++)
+		wmvm_draw_char(strip, i < len ? str[i] : ' ', i);
+
+	return strip;
+}
+
+/* Current volume name or status message, None if there is nothing to show */
+static Pixmap wmvm_text_strip(int *width)
+{
+	WMVMVolume *current = wmvm_model_current();
+	WMVMVolumeView *view;
+
+	if (message != NULL) {
+		if (message_strip == None)
+			message_strip = wmvm_make_strip(message, &message_width);
+		*width = message_width;
+		return message_strip;
 	}
+
+	if (current != NULL) {
+		if (current->display_name == NULL)
+			return None;
+		if ((view = current->view) == NULL) {
+			view = current->view = g_new(WMVMVolumeView, 1);
+			view->strip = wmvm_make_strip(current->display_name, &view->strip_width);
+		}
+		*width = view->strip_width;
+		return view->strip;
+	}
+
+	if (status != NULL) {
+		if (status_strip == None)
+			status_strip = wmvm_make_strip(status, &status_width);
+		*width = status_width;
+		return status_strip;
+	}
+
+	return None;
+}
+
+static void wmvm_draw_string(void)
+{
+	Pixmap strip;
+	int width, x = cpos;
+
+	if ((strip = wmvm_text_strip(&width)) == None) {
+		strip = blank_strip;
+		x = 0;
+	}
+
+	XCopyArea(DADisplay, strip, master->pixmap, DAGC,
+			  x, 0, TEXT_WIDTH, TEXT_HEIGHT, TEXT_X, TEXT_Y);
+}
+
+static void wmvm_refresh_text(void)
+{
+	XCopyArea(DADisplay, master->pixmap, DAWindow, DAGC,
+			  TEXT_X, TEXT_Y, TEXT_WIDTH, TEXT_HEIGHT, TEXT_X, TEXT_Y);
+}
+
+static gboolean wmvm_scroll_resume(gpointer data)
+{
+	wmvm_stat_inc(WMVM_STAT_TIMER_WAKEUP);
+	scroll_id = g_timeout_add(scroll_interval, wmvm_timeout, NULL);
+
+	return FALSE;
+}
+
+/* Pauses are long, let them share wakeups with other per-second timers */
+static void wmvm_pause_scroll(void)
+{
+	scroll_id = g_timeout_add_seconds(1, wmvm_scroll_resume, NULL);
+}
+
+static void wmvm_stop_scroll(void)
+{
+	if (scroll_id != 0) {
+		g_source_remove(scroll_id);
+		scroll_id = 0;
+	}
+}
+
+static void wmvm_reset_scroll(void)
+{
+	cpos = 0;
+	dpos = scroll_step;
+	wmvm_stop_scroll();
+}
+
+static void wmvm_update_scroll_timer(void)
+{
+	int width;
+
+	if (!visible || wmvm_text_strip(&width) == None || width <= TEXT_WIDTH)
+		wmvm_stop_scroll();
+	else if (scroll_id == 0)
+		wmvm_pause_scroll();
 }
 
 static gboolean wmvm_timeout(gpointer data)
 {
-	if (tpause == 0 && current && current->display_name && strlen(current->display_name) > MAX_POS) {
-		cpos += dpos;
-		if (cpos <= 0 || cpos >= strlen(current->display_name) - MAX_POS) {
-			cpos = (cpos <= 0) ? 0 : (strlen(current->display_name) - MAX_POS);
-			dpos *= -1;
-			tpause = 2;
-		}
-		wmvm_draw_string(current->display_name);
-		wmvm_refresh_window();
-		return TRUE;
+	int width;
+
+	wmvm_stat_inc(WMVM_STAT_TIMER_WAKEUP);
+
+	if (wmvm_text_strip(&width) == None) {
+		scroll_id = 0;
+		return FALSE;
+	}
+
+	cpos += dpos;
+	wmvm_queue_render(DIRTY_TEXT);
+
+	if (cpos <= 0 || cpos >= width - TEXT_WIDTH) {
+		cpos = (cpos <= 0) ? 0 : (width - TEXT_WIDTH);
+		dpos *= -1;
+		wmvm_pause_scroll();
+		return FALSE;
 	}
-	if (tpause > 0)
-		tpause--;
+
 	return TRUE;
 }
 
-static void wmvm_update_button_state(WMVMVolume *vol)
+static void wmvm_set_visible(gboolean v)
 {
-	GList *c;
+	if (visible != v) {
+		visible = v;
+		wmvm_update_scroll_timer();
+	}
+}
 
-	if (vol != NULL && vol == current && (c = g_list_find(wmvm_volumes, vol)) != NULL) {
-		if (vol->busy) {
+static void wmvm_update_button_state(void)
+{
+	WMVMVolume *vol = wmvm_model_current();
+
+	if (vol != NULL) {
+		if (vol->busy || vol->error) {
 			wmvm_buttons[BUTT_MOUNT].state = STATE_RED;
 		} else if (!vol->mountable) {
 			wmvm_buttons[BUTT_MOUNT].state = STATE_DISABLED;
@@ -257,12 +486,12 @@ static void wmvm_update_button_state(WMVMVolume *vol)
 				   wmvm_buttons[BUTT_MOUNT].state == STATE_RED) {
 			wmvm_buttons[BUTT_MOUNT].state = STATE_NORMAL;
 		}
-		if (g_list_previous(c) == NULL) {
+		if (wmvm_model_prev(vol) == NULL) {
 			wmvm_buttons[BUTT_LEFT].state = STATE_DISABLED;
 		} else if (wmvm_buttons[BUTT_LEFT].state == STATE_DISABLED) {
 			wmvm_buttons[BUTT_LEFT].state = STATE_NORMAL;
 		}
-		if (g_list_next(c) == NULL) {
+		if (wmvm_model_next(vol) == NULL) {
 			wmvm_buttons[BUTT_RIGHT].state = STATE_DISABLED;
 		} else if (wmvm_buttons[BUTT_RIGHT].state == STATE_DISABLED) {
 			wmvm_buttons[BUTT_RIGHT].state = STATE_NORMAL;
@@ -270,408 +499,384 @@ static void wmvm_update_button_state(WMVMVolume *vol)
 	}
 }
 
-void wmvm_update_icon(void)
+/* Earliest change waiting for repaint, see wmvm_note_event() */
+static gint64 event_time = 0;
+static guint event_count = 0;
+
+static gboolean wmvm_render(gpointer data)
 {
+	WMVMVolume *current = wmvm_model_current();
 	int i;
 
+	render_id = 0;
+	last_render = g_get_monotonic_time();
+	wmvm_stat_inc(WMVM_STAT_REPAINT);
+
 	if (current != NULL) {
 		/* buttons */
-		/*wmvm_update_button_state(current);*/
-
 		if (pressed != -1 && (wmvm_buttons[pressed].state == STATE_DISABLED ||
 							  wmvm_buttons[pressed].state == STATE_RED))
 			pressed = -1;
 
-		if (current->mounted) {
-			DASPCopyArea(buttons, buttons, 54, 0, 28, 44, 0, 0);
-		} else {
-			DASPCopyArea(buttons, buttons, 82, 0, 28, 44, 0, 0);
+		if (dirty & DIRTY_MOUNT) {
+			if (current->mounted) {
+				DASPCopyArea(buttons, buttons, 54, 0, 28, 44, 0, 0);
+			} else {
+				DASPCopyArea(buttons, buttons, 82, 0, 28, 44, 0, 0);
+			}
+		}
+
+		if (dirty & (DIRTY_BUTTONS | DIRTY_MOUNT)) {
+			wmvm_draw_button(BUTT_MOUNT);
+			wmvm_draw_button(BUTT_LEFT);
+			wmvm_draw_button(BUTT_RIGHT);
 		}
 
-		wmvm_draw_button(BUTT_MOUNT);
-		wmvm_draw_button(BUTT_LEFT);
-		wmvm_draw_button(BUTT_RIGHT);
+		if (dirty & DIRTY_ICON)
+			wmvm_draw_icon(wmvm_device_icon(current->icon));
 
-		if (current->icon)
-			DASPSetPixmapForWindow(iconWin, current->icon);
-		else
-			DASPSetPixmapForWindow(iconWin, icon_none);
 		/* text */
-		wmvm_draw_string(current->display_name);
+		if (dirty & DIRTY_TEXT)
+			wmvm_draw_string();
 	} else {
-		pressed = -1;
-		for (i = 0; i < 3; i++) {
-			wmvm_buttons[i].state = STATE_DISABLED;
-			wmvm_draw_button(i);
+		if (dirty & ~DIRTY_TEXT) {
+			pressed = -1;
+			for (i = 0; i < 3; i++) {
+				wmvm_buttons[i].state = STATE_DISABLED;
+				wmvm_draw_button(i);
+			}
+			wmvm_draw_icon(icon_none);
 		}
-		DASPSetPixmapForWindow(iconWin, icon_none);
-		for (i = 0; i < MAX_POS; i++)
-			wmvm_draw_char(' ', i);
+		wmvm_draw_string();
 	}
 
-	wmvm_refresh_window();
-}
+	/* scrolling touches only the text area */
+	if (dirty == DIRTY_TEXT)
+		wmvm_refresh_text();
+	else if (dirty & ~DIRTY_ICON)
+		wmvm_refresh_window();
 
-static void wmvm_set_current(WMVMVolume *newcur)
-{
-	gboolean needs_update = current != newcur;
+	dirty = 0;
 
-	current = newcur;
-	if (needs_update)
-	{
-		cpos = 0;
-		dpos = 1;
-		tpause = 2;
-		pressed = -1;
-		wmvm_update_button_state(current);
-		wmvm_update_icon();
+	wmvm_update_scroll_timer();
+	wmvm_x_flush();
+
+	if (event_time != 0) {
+		gint64 latency = g_get_monotonic_time() - event_time;
+
+		wmvm_stat_record(WMVM_HIST_SIGNAL_TO_PAINT, latency);
+		g_debug("repainted %" G_GINT64_FORMAT " us after first of %u events",
+				latency, event_count);
+		event_time = 0;
+		event_count = 0;
 	}
+
+	return FALSE;
 }
 
-static void wmvm_free_volume(WMVMVolume *vol)
+/* Repaint at most once per main loop iteration and once per frame */
+static void wmvm_queue_render(guint what)
 {
-	if (vol == NULL)
-		return;
+	gint64 delay;
 
-	if (vol->udi) free(vol->udi);
-	if (vol->device) free(vol->device);
-	if (vol->mountpoint) free(vol->mountpoint);
-	free(vol);
-}
+	dirty |= what;
 
-static void wmvm_mountumount(void)
-{
-	if (current != NULL && current->device != NULL) {
-		if (current->busy)
-			return;
+	if (render_id != 0 || wmvm_model_in_update())
+		return;
 
-		if (current->mounted) {
-			udisks_device_unmount(current->udi);
-		} else {
-			udisks_device_mount(current->udi);
-		}
-	}
-	wmvm_draw_button(pressed);
-	wmvm_refresh_window();
+	delay = last_render + render_interval - g_get_monotonic_time();
+
+	if (delay > 0)
+		render_id = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE + 10, (delay + 999) / 1000, wmvm_render, NULL, NULL);
+	else
+		render_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE + 10, wmvm_render, NULL, NULL);
 }
 
-static void wmvm_list_left(void)
+/*
+ * Called by the backend with the time its changes arrived, once they
+ * are applied.  Changes that did not need a repaint are not tracked.
+ */
+void wmvm_note_event(gint64 when, guint count)
 {
-	GList *c;
+	if (render_id == 0 && dirty == 0)
+		return;
 
-	if (current != NULL && (c = g_list_find(wmvm_volumes, current)) != NULL)
-		if (g_list_previous(c) != NULL)
-			wmvm_set_current(g_list_previous(c)->data);
+	if (event_time == 0 || when < event_time)
+		event_time = when;
+	event_count += count;
 }
 
-static void wmvm_list_right(void)
+void wmvm_update_icon(void)
 {
-	GList *c;
-
-	if (current != NULL && (c = g_list_find(wmvm_volumes, current)) != NULL)
-		if (g_list_next(c) != NULL)
-			wmvm_set_current(g_list_next(c)->data);
+	wmvm_queue_render(DIRTY_ALL);
 }
 
-static void da_button_press(int button, int state, int x, int y)
+/* Replace text and drop its strip, FALSE if nothing changed */
+static gboolean wmvm_replace_text(char **text, Pixmap *strip, const char *new_text)
 {
-	int i;
+	if (g_strcmp0(*text, new_text) == 0)
+		return FALSE;
 
-	switch(button){
-	case 1:
-		pressed = -1;
-		for (i = 0; i < sizeof(wmvm_buttons)/sizeof(wmvm_buttons[0]); i++)
-			if (wmvm_buttons[i].state != STATE_DISABLED &&
-				wmvm_buttons[i].state != STATE_RED && IN_RECT(x, y, &(wmvm_buttons[i].r)))
-				pressed = i;
+	if (*text) free(*text);
+	*text = new_text ? strdup(new_text) : NULL;
 
-		if (pressed != -1) {
-			wmvm_buttons[pressed].state = STATE_DOWN;
-			wmvm_draw_button(pressed);
-			wmvm_refresh_window();
-		}
-		break;
-	case 4:
-		if (IN_RECT(x, y, &icon_area)) {
-			wmvm_list_left();
-		}
-		break;
-	case 5:
-		if (IN_RECT(x, y, &icon_area)) {
-			wmvm_list_right();
-		}
-		break;
-	default:
-		break;
+	if (*strip != None) {
+		XFreePixmap(DADisplay, *strip);
+		*strip = None;
 	}
+
+	return TRUE;
 }
 
-static void da_button_release(int button, int state, int x, int y)
+void wmvm_set_status(const char *text)
 {
-	int i, p = -1;
-
-	if(pressed == -1)
+	if (!wmvm_replace_text(&status, &status_strip, text))
 		return;
 
-	for (i = 0; i < sizeof(wmvm_buttons)/sizeof(wmvm_buttons[0]); i++)
-		if (IN_RECT(x, y, &(wmvm_buttons[i].r)))
-			p = i;
+	if (message == NULL && wmvm_model_current() == NULL) {
+		wmvm_reset_scroll();
+		wmvm_queue_render(DIRTY_TEXT);
+	}
+}
 
-	if(wmvm_buttons[pressed].state != STATE_DOWN)
+void wmvm_set_message(const char *text)
+{
+	if (!wmvm_replace_text(&message, &message_strip, text))
 		return;
 
-	wmvm_buttons[pressed].state = STATE_NORMAL;
-
-	if (pressed == p && wmvm_buttons[pressed].action)
-		(*wmvm_buttons[pressed].action)();
-	else
-		wmvm_update_icon();
-
-	pressed = -1;
+	wmvm_reset_scroll();
+	wmvm_queue_render(DIRTY_TEXT);
 }
 
-static void wmvm_set_title(WMVMVolume *vol)
+static void wmvm_free_view(WMVMVolume *vol)
 {
-	gboolean needs_update = (current == vol);
-
-	if (vol->mountpoint && *vol->mountpoint) {
-		needs_update = needs_update && (vol->display_name != vol->mountpoint);
-		vol->display_name = vol->mountpoint;
-	} else {
-		needs_update = needs_update && (vol->display_name != vol->device);
-		vol->display_name = vol->device;
-	}
+	WMVMVolumeView *view = vol->view;
 
-	if (needs_update)
-	{
-		cpos = 0;
-		dpos = 1;
-		tpause = 2;
-		wmvm_draw_string(current->display_name);
+	if (view != NULL) {
+		XFreePixmap(DADisplay, view->strip);
+		g_free(view);
+		vol->view = NULL;
 	}
 }
 
-static WMVMVolume *wmvm_find_volume(const char *udi)
+/* Model observer, turns volume changes into repaints */
+static void wmvm_volume_changed(WMVMVolume *vol, guint what)
 {
-	WMVMVolume *ret = NULL;
-	GList *i;
+	guint needs_update = 0;
 
-	if (udi == NULL)
-		return NULL;
+	if (vol != NULL && (what & WMVM_CHANGED_TITLE))
+		wmvm_free_view(vol);
 
-	for (i = g_list_first(wmvm_volumes); i != NULL; i = g_list_next(i)) {
-		ret = i->data;
-		if (ret && strcmp(ret->udi, udi) == 0)
-			break;
-	}
+	if (vol != NULL && vol != wmvm_model_current())
+		return;
 
-	return (i == NULL ? NULL : ret);
+	if (what & WMVM_CHANGED_CURRENT) {
+		wmvm_reset_scroll();
+		pressed = -1;
+		needs_update |= DIRTY_ALL;
+	}
+	if (vol != NULL && (what & WMVM_CHANGED_TITLE)) {
+		wmvm_reset_scroll();
+		needs_update |= DIRTY_TEXT;
+	}
+	if (what & WMVM_CHANGED_MOUNT)
+		needs_update |= DIRTY_MOUNT;
+	if (what & WMVM_CHANGED_ICON)
+		needs_update |= DIRTY_ICON;
+	if (what & (WMVM_CHANGED_STATE | WMVM_CHANGED_LIST))
+		needs_update |= DIRTY_BUTTONS;
+	if (what == WMVM_CHANGED_ALL)
+		needs_update |= DIRTY_ALL;
+
+	wmvm_update_button_state();
+	wmvm_queue_render(needs_update);
 }
 
-gboolean wmvm_is_managed_volume(const char *udi)
+/* Do not switch volumes under a pressed button */
+static gboolean wmvm_may_select(void)
 {
-	return (wmvm_find_volume(udi) != NULL);
+	return pressed == -1;
 }
 
-void wmvm_update_volume(const char *udi, const char *device, int icon, gboolean mountable)
-{
-	WMVMVolume *vol;
-	gboolean is_new;
-
-	if (udi == NULL || device == NULL)
-		return;
-
-	is_new = FALSE;
-	vol = wmvm_find_volume(udi);
+static const WMVMModelObserver wmvm_observer = {
+	wmvm_volume_changed,
+	wmvm_free_view,
+	wmvm_may_select
+};
 
-	if (vol == NULL) {
-		is_new = TRUE;
-		vol = calloc(1, sizeof(WMVMVolume));
+static void wmvm_mountumount(void)
+{
+	WMVMVolume *current = wmvm_model_current();
 
-		if (vol == NULL)
+	if (current != NULL && current->device != NULL) {
+		if (current->busy)
 			return;
-	}
-
-	if (is_new) {
-		vol->udi = strdup(udi);
-		vol->device = strdup(device);
-	}
-	vol->mountable = mountable;
-	vol->busy = FALSE;
-	vol->error = FALSE;
-	if (icon >= WMVM_ICON_UNKNOWN && icon < WMVM_ICON_MAX)
-		vol->icon = wmvm_device_icons[icon];
-	else
-		vol->icon = wmvm_device_icons[WMVM_ICON_UNKNOWN];
-
-	if (is_new) {
-		wmvm_set_title(vol);
-
-		wmvm_volumes = g_list_append(wmvm_volumes, vol);
-	}
 
-	if (pressed == -1 || current == NULL) {
-		wmvm_update_button_state(vol);
-		wmvm_set_current(vol);
-	} else {
-		wmvm_update_button_state(current);
-		wmvm_update_icon();
+		if (current->mounted) {
+			udisks_device_unmount(current->udi);
+		} else {
+			udisks_device_mount(current->udi);
+		}
 	}
-
-	return;
+	wmvm_queue_render(DIRTY_BUTTONS);
 }
 
-void wmvm_remove_volume(const char *udi)
+/* Middle click: mount every volume, or unmount if current one is mounted */
+static void wmvm_mountumount_all(void)
 {
+	WMVMVolume *current = wmvm_model_current();
 	WMVMVolume *vol;
+	GPtrArray *paths;
 
-	if ((vol = wmvm_find_volume(udi)) == NULL)
+	if (current == NULL || current->busy)
 		return;
 
+	paths = g_ptr_array_new();
+	for (vol = wmvm_model_first(); vol != NULL; vol = wmvm_model_next(vol))
+		if (vol->mountable && !vol->busy && vol->mounted == current->mounted)
+			g_ptr_array_add(paths, (gpointer) vol->udi);
+	g_ptr_array_add(paths, NULL);
 
-	if (current == vol) {
-		GList *c = g_list_find(wmvm_volumes, vol);
-
-		if (g_list_previous(c))
-			wmvm_set_current(g_list_previous(c)->data);
-		else if (g_list_next(c))
-			wmvm_set_current(g_list_next(c)->data);
-		else
-			wmvm_set_current(NULL);
-	}
-
-	wmvm_volumes = g_list_remove(wmvm_volumes, vol);
-	wmvm_free_volume(vol);
+	if (current->mounted)
+		udisks_device_unmount_all((const char *const *) paths->pdata);
+	else
+		udisks_device_mount_all((const char *const *) paths->pdata);
 
-	wmvm_update_button_state(current);
-	wmvm_update_icon();
+	g_ptr_array_free(paths, TRUE);
 }
 
-void wmvm_remove_all_volumes(void)
+/* Right click: make the whole drive of current volume safe to remove */
+static void wmvm_detach(void)
 {
-	wmvm_set_current(NULL);
+	WMVMVolume *current = wmvm_model_current();
 
-	while (wmvm_volumes && wmvm_volumes->data) {
-		WMVMVolume *vol;
-		vol = wmvm_volumes->data;
-
-		wmvm_volumes = g_list_remove(wmvm_volumes, vol);
-		wmvm_free_volume(vol);
-	}
+	if (current == NULL || current->busy)
+		return;
 
-	wmvm_update_button_state(current);
-	wmvm_update_icon();
+	udisks_drive_detach(current->udi);
 }
 
-void wmvm_volume_set_mount_status(const char *udi, const char *mountpoint, gboolean mounted)
+static void wmvm_list_left(void)
 {
-	WMVMVolume *vol;
-	gboolean needs_update = FALSE;
+	WMVMVolume *prev;
 
-	if ((vol = wmvm_find_volume(udi)) == NULL)
-		return;
+	if ((prev = wmvm_model_prev(wmvm_model_current())) != NULL)
+		wmvm_model_set_current(prev);
+}
 
-	if (vol->mounted != mounted) {
-		vol->mounted = mounted;
+static void wmvm_list_right(void)
+{
+	WMVMVolume *next;
 
-		wmvm_update_button_state(vol);
-		needs_update = TRUE;
-	}
+	if ((next = wmvm_model_next(wmvm_model_current())) != NULL)
+		wmvm_model_set_current(next);
+}
 
-	if ((vol->mountpoint != NULL && mountpoint != NULL && strcmp(vol->mountpoint, mountpoint)) ||
-		(vol->mountpoint == NULL && mountpoint != NULL) ||
-		(vol->mountpoint != NULL && mountpoint == NULL)) {
-		if (vol->mountpoint) free(vol->mountpoint);
-		vol->mountpoint = NULL;
-		if (mountpoint)
-			vol->mountpoint = strdup(mountpoint);
+/* Red mount button is busy, or last operation failed and may be retried */
+static gboolean wmvm_button_pressable(int b)
+{
+	WMVMVolume *current = wmvm_model_current();
 
-		wmvm_set_title(vol);
-		needs_update = TRUE;
-	}
+	if (wmvm_buttons[b].state == STATE_DISABLED)
+		return FALSE;
+	if (wmvm_buttons[b].state == STATE_RED)
+		return b == BUTT_MOUNT && current != NULL && !current->busy;
 
-	if (needs_update)
-		wmvm_update_icon();
+	return TRUE;
 }
 
-void wmvm_volume_set_busy(const char *udi, gboolean busy)
+static void da_button_press(int button, int state, int x, int y)
 {
-	WMVMVolume *vol;
-
-	if ((vol = wmvm_find_volume(udi)) == NULL)
-		return;
+	int i;
 
-	if (vol->busy != busy) {
-		vol->busy = busy;
+	switch(button){
+	case 1:
+		pressed = -1;
+		for (i = 0; i < sizeof(wmvm_buttons)/sizeof(wmvm_buttons[0]); i++)
+			if (wmvm_button_pressable(i) && IN_RECT(x, y, &(wmvm_buttons[i].r)))
+				pressed = i;
 
-		wmvm_update_button_state(vol);
-		wmvm_update_icon();
+		if (pressed != -1) {
+			wmvm_buttons[pressed].state = STATE_DOWN;
+			wmvm_queue_render(DIRTY_BUTTONS);
+		}
+		break;
+	case 2:
+		if (wmvm_button_pressable(BUTT_MOUNT) && IN_RECT(x, y, &(wmvm_buttons[BUTT_MOUNT].r)))
+			wmvm_mountumount_all();
+		break;
+	case 3:
+		if (IN_RECT(x, y, &icon_area))
+			wmvm_detach();
+		break;
+	case 4:
+		if (IN_RECT(x, y, &icon_area)) {
+			wmvm_list_left();
+		}
+		break;
+	case 5:
+		if (IN_RECT(x, y, &icon_area)) {
+			wmvm_list_right();
+		}
+		break;
+	default:
+		break;
 	}
 }
 
-void wmvm_volume_set_error(const char *udi, gboolean error)
+static void da_button_release(int button, int state, int x, int y)
 {
-	WMVMVolume *vol;
+	int i, p = -1;
 
-	if ((vol = wmvm_find_volume(udi)) == NULL)
+	if(pressed == -1)
 		return;
 
-	if (vol->error != error) {
-		vol->error = error;
+	for (i = 0; i < sizeof(wmvm_buttons)/sizeof(wmvm_buttons[0]); i++)
+		if (IN_RECT(x, y, &(wmvm_buttons[i].r)))
+			p = i;
 
-		wmvm_update_icon();
-	}
+	if(wmvm_buttons[pressed].state != STATE_DOWN)
+		return;
+
+	wmvm_buttons[pressed].state = STATE_NORMAL;
+
+	if (pressed == p && wmvm_buttons[pressed].action)
+		(*wmvm_buttons[pressed].action)();
+	else
+		wmvm_queue_render(DIRTY_BUTTONS);
+
+	pressed = -1;
 }
 
 static void wmvm_init_icons(char *theme)
 {
 #include "icon_none.xpm"
+	DAShapedPixmap *pix;
 	int i;
-	gchar *usericondir = NULL;
-	gchar *globalicondir = WMVM_ICONS_DIR;
-	const gchar *home = g_getenv("HOME");
-
-	icon_none = DAMakeShapedPixmapFromData(icon_none_xpm);
-
-	if (NULL == theme || 0 == theme[0])
-		theme = "default";
-
-	if (home && *home)
-		usericondir = g_build_filename(home, ".wmvolman", NULL);
-
-	for (i = WMVM_ICON_UNKNOWN; i < WMVM_ICON_MAX; i++) {
-		int j;
-		DAShapedPixmap *pix = NULL;
-		gchar *file = NULL;
-		gchar *p;
-
-		wmvm_device_icons[i] = icon_none;
-
-		for (p = usericondir, j = 2; j; p = globalicondir, j--) {
-			if (p && *p) {
-				file = g_build_filename(p, theme,  wmvm_device_icon_names[i].name, NULL);
-				if (file && *file && g_file_test(file, G_FILE_TEST_EXISTS)) {
-					pix = DAMakeShapedPixmapFromFile(file);
-					g_free(file);
-					file = NULL;
-					break;
-				}
-				if (file) {
-					g_free(file);
-					file = NULL;
-				}
-			}
-		}
-		if (pix != NULL || wmvm_device_icon_names[i].fallback != -1)
-			wmvm_device_icons[i] = (pix == NULL && wmvm_device_icon_names[i].fallback != -1 ) ? wmvm_device_icons[wmvm_device_icon_names[i].fallback] : pix;
-	}
 
-	if (usericondir) g_free(usericondir);
+	icon_atlas = XCreatePixmap(DADisplay, DAWindow, ICON_WIDTH, ICON_HEIGHT * ICON_SLOTS, DADepth);
+	icon_atlas_mask = XCreatePixmap(DADisplay, DAWindow, ICON_WIDTH, ICON_HEIGHT * ICON_SLOTS, 1);
+	icon_mask_gc = XCreateGC(DADisplay, icon_atlas_mask, 0, NULL);
+	XSetForeground(DADisplay, icon_mask_gc, 0);
+	XFillRectangle(DADisplay, icon_atlas_mask, icon_mask_gc, 0, 0, ICON_WIDTH, ICON_HEIGHT * ICON_SLOTS);
+	XSetForeground(DADisplay, icon_mask_gc, 1);
+
+	if ((pix = DAMakeShapedPixmapFromData(icon_none_xpm)) != NULL)
+		icon_none = wmvm_atlas_add(pix);
+	else
+		icon_none = icon_slots++;
+
+	for (i = WMVM_ICON_UNKNOWN; i < WMVM_ICON_MAX; i++)
+		wmvm_device_icons[i] = -1;
+
+	wmvm_theme_init(theme);
 }
 
-gboolean wmvm_init_dockapp(char *dpyName, int argc, char *argv[], char *theme)
+gboolean wmvm_init_dockapp(char *dpyName, int argc, char *argv[], char *theme, int fps, gboolean smooth)
 {
 	WMVMSource *wmvm_source;
+	int blank_width;
+	XWindowAttributes attrs;
 	static GSourceFuncs event_funcs = {
 		wmvm_event_prepare,
 		wmvm_event_check,
@@ -688,6 +893,8 @@ gboolean wmvm_init_dockapp(char *dpyName, int argc, char *argv[], char *theme)
 		NULL				/* timeout */
 	};
 
+	wmvm_model_set_observer(&wmvm_observer);
+
 	DAInitialize(dpyName, "WMVolMan", 64, 64, argc, argv);
 	DASetCallbacks(&cb);
 
@@ -698,10 +905,23 @@ gboolean wmvm_init_dockapp(char *dpyName, int argc, char *argv[], char *theme)
 
 	wmvm_init_icons(theme);
 
+	if (fps > 0)
+		render_interval = G_USEC_PER_SEC / fps;
+
+	if (smooth) {
+		scroll_step = 1;
+		scroll_interval = 250 / CHAR_WIDTH;
+	}
+	dpos = scroll_step;
+
+	blank_strip = wmvm_make_strip(NULL, &blank_width);
+
 	DASPSetPixmap(master);
 
-	iconWin = XCreateSimpleWindow(DADisplay, DAWindow, 22, 18, 36, 24, 0, 0, 0);
-	DASPSetPixmapForWindow(iconWin, icon_none);
+	iconWin = XCreateSimpleWindow(DADisplay, DAWindow, 22, 18, ICON_WIDTH, ICON_HEIGHT, 0, 0, 0);
+	XSetWindowBackgroundPixmap(DADisplay, iconWin, None);
+	XSelectInput(DADisplay, iconWin, ExposureMask);
+	wmvm_draw_icon(icon_none);
 
 	if ((wmvm_source = (WMVMSource *) g_source_new(&event_funcs, sizeof(WMVMSource))) == NULL)
 		return FALSE;
@@ -715,7 +935,8 @@ gboolean wmvm_init_dockapp(char *dpyName, int argc, char *argv[], char *theme)
 	g_source_attach((GSource *)wmvm_source, NULL);
 	g_source_unref((GSource *)wmvm_source);
 
-	g_timeout_add(250, wmvm_timeout, NULL);
+	XGetWindowAttributes(DADisplay, DAWindow, &attrs);
+	XSelectInput(DADisplay, DAWindow, attrs.your_event_mask | VisibilityChangeMask | StructureNotifyMask);
 
 	DAShow();
 
@@ -51,19 +51,20 @@ enum WMVMIconName {
 	WMVM_ICON_CARD_MS,
 	WMVM_ICON_CARD_SDMMC,
 	WMVM_ICON_CARD_SM,
+	WMVM_ICON_HARDDISK_SDIO,
+	WMVM_ICON_HARDDISK_NVME,
+	WMVM_ICON_HARDDISK_THUNDERBOLT,
+	WMVM_ICON_REMOVABLE_SDIO,
+	WMVM_ICON_REMOVABLE_THUNDERBOLT,
 	WMVM_ICON_MAX
 };
 
 void wmvm_update_icon(void);
-gboolean wmvm_is_managed_volume(const char *udi);
-void wmvm_update_volume(const char *udi, const char *device, int icon, gboolean mountable);
-void wmvm_remove_volume(const char *udi);
-void wmvm_remove_all_volumes(void);
-void wmvm_volume_set_mount_status(const char *udi, const char *mountpoint, gboolean mounted);
-void wmvm_volume_set_busy(const char *udi, gboolean busy);
-void wmvm_volume_set_error(const char *udi, gboolean error);
+void wmvm_note_event(gint64 when, guint count);
+void wmvm_set_status(const char *text);
+void wmvm_set_message(const char *text);
 
-gboolean wmvm_init_dockapp(char *dpyName, int argc, char *argv[], char *theme);
+gboolean wmvm_init_dockapp(char *dpyName, int argc, char *argv[], char *theme, int fps, gboolean smooth);
 
 void wmvm_run_dockapp(void);
 
@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# bench-udisks.sh - end-to-end latency benchmark against fake udisksd
+#
+# For every N in $WMVM_BENCH_SIZES (default "10 100 1000") a fresh
+# wmvolman watches N drives being plugged in, mounted and unmounted
+# twice, and removed.  Reported per N: D-Bus signals handled, repaints
+# and repaints per signal, signal-to-repaint latency percentiles, CPU
+# time and peak RSS.  Fails if wmvolman dies, or if from N=100 on
+# repaints exceed a quarter of the signals, which means bursts are not
+# coalesced.  Run by "make bench", not "make check".
+
+. "${srcdir:-.}/harness.sh"
+
+sizes=${WMVM_BENCH_SIZES:-"10 100 1000"}
+max_ratio=0.25
+
+start_bus
+start_x
+
+printf '%6s %8s %8s %8s %8s %8s %8s %8s %8s\n' \
+	N signals repaints rep/sig "p50 us" "p90 us" "p99 us" "cpu ms" "rss kB"
+
+for n in $sizes; do
+	settle=$((1 + n / 500))
+
+	start_fake
+	start_wmvolman
+
+	fake Hotplug uint32:$n string:usb string:vfat
+	sleep $settle
+	fake Storm uint32:2
+	sleep $settle
+	fake RemoveAll
+	sleep $settle
+
+	dump_stats
+
+	signals=0
+	for c in object-added object-removed interface-added interface-removed properties-changed; do
+		signals=$((signals + $(counter "$c signals")))
+	done
+	repaints=$(counter repaints)
+	p50=$(hist "signal to paint" p50)
+	p90=$(hist "signal to paint" p90)
+	p99=$(hist "signal to paint" p99)
+
+	printf '%6s %8s %8s %8s %8s %8s %8s %8s %8s\n' $n $signals $repaints \
+		$(awk -v r=$repaints -v s=$signals 'BEGIN { printf "%.3f", s ? r / s : 0 }') \
+		${p50:--} ${p90:--} ${p99:--} $(cpu_ms) $(rss_kb)
+
+	[ $signals -gt 0 ] || fail "no signals reached wmvolman with N=$n"
+	[ $n -lt 100 ] || awk -v r=$repaints -v s=$signals -v m=$max_ratio 'BEGIN { exit !(r <= s * m) }' ||
+		fail "$repaints repaints for $signals signals with N=$n, more than $max_ratio per signal"
+
+	stop_wmvolman
+	stop_fake
+done
+
+exit 0
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+#
+# fake-udisks.py - scriptable org.freedesktop.UDisks2 for wmvolman tests
+#
+# Copyright (C) 2026  wmVolMan contributors
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# Owns org.freedesktop.UDisks2 on the bus in DBUS_SYSTEM_BUS_ADDRESS and
+# serves an object manager with drives, blocks and filesystems.  With
+# COUNT BUS TYPE arguments it starts with drives already plugged in, as
+# if udisksd was restarted.  Tests drive it through org.wmvolman.Test on
+# /org/freedesktop/UDisks2:
+#
+#   Hotplug(u count, s bus, s type)	add count drives with one filesystem each
+#   Storm(u rounds)					mount and unmount every filesystem, rounds times
+#   MountAll()						mount every filesystem
+#   RemoveAll()						remove every drive and block
+#   Mounted() -> u					number of mounted filesystems
+#   LastOptions(s device) -> s		"options" of the last Mount() call on device
+#
+# Filesystem.Mount/Unmount and Drive.Eject/PowerOff work like udisksd,
+# without touching any device.
+
+import sys
+
+import dbus
+import dbus.service
+import dbus.mainloop.glib
+from gi.repository import GLib
+
+BUS_NAME = 'org.freedesktop.UDisks2'
+ROOT = '/org/freedesktop/UDisks2'
+
+OBJECT_MANAGER = 'org.freedesktop.DBus.ObjectManager'
+PROPERTIES = 'org.freedesktop.DBus.Properties'
+MANAGER = 'org.freedesktop.UDisks2.Manager'
+DRIVE = 'org.freedesktop.UDisks2.Drive'
+BLOCK = 'org.freedesktop.UDisks2.Block'
+FILESYSTEM = 'org.freedesktop.UDisks2.Filesystem'
+TEST = 'org.wmvolman.Test'
+
+
+def bytestring(s):
+	return dbus.Array([dbus.Byte(c) for c in s.encode() + b'\0'], signature='y')
+
+
+def bytestring_list(strings):
+	return dbus.Array([bytestring(s) for s in strings], signature='ay')
+
+
+class FakeObject(dbus.service.Object):
+	def __init__(self, root, path, interfaces):
+		self.root = root
+		self.path = path
+		self.interfaces = interfaces
+		self.last_options = ''
+		dbus.service.Object.__init__(self, root.bus_name, path)
+
+	def update(self, interface, props):
+		self.interfaces[interface].update(props)
+		self.PropertiesChanged(interface, dbus.Dictionary(props, signature='sv'),
+							   dbus.Array([], signature='s'))
+
+	def mounted(self):
+		return FILESYSTEM in self.interfaces and len(self.interfaces[FILESYSTEM]['MountPoints']) > 0
+
+	@dbus.service.method(PROPERTIES, in_signature='ss', out_signature='v')
+	def Get(self, interface, name):
+		return self.interfaces[interface][name]
+
+	@dbus.service.method(PROPERTIES, in_signature='s', out_signature='a{sv}')
+	def GetAll(self, interface):
+		return dbus.Dictionary(self.interfaces.get(interface, {}), signature='sv')
+
+	@dbus.service.signal(PROPERTIES, signature='sa{sv}as')
+	def PropertiesChanged(self, interface, changed, invalidated):
+		pass
+
+	@dbus.service.method(FILESYSTEM, in_signature='a{sv}', out_signature='s')
+	def Mount(self, options):
+		mountpoint = '/media/fake/%s' % self.path.rsplit('/', 1)[-1]
+		self.last_options = str(options.get('options', ''))
+		self.update(FILESYSTEM, {'MountPoints': bytestring_list([mountpoint])})
+		return mountpoint
+
+	@dbus.service.method(FILESYSTEM, in_signature='a{sv}')
+	def Unmount(self, options):
+		self.update(FILESYSTEM, {'MountPoints': bytestring_list([])})
+
+	@dbus.service.method(DRIVE, in_signature='a{sv}')
+	def Eject(self, options):
+		self.update(DRIVE, {'MediaAvailable': dbus.Boolean(False)})
+
+	@dbus.service.method(DRIVE, in_signature='a{sv}')
+	def PowerOff(self, options):
+		self.root.remove_drive(self.path)
+
+
+class FakeUDisks(dbus.service.Object):
+	def __init__(self, bus_name):
+		self.bus_name = bus_name
+		self.objects = {}
+		self.next_id = 0
+		dbus.service.Object.__init__(self, bus_name, ROOT)
+		self.add(ROOT + '/Manager', {
+			MANAGER: {'Version': dbus.String('2.10.0')},
+		})
+
+	def add(self, path, interfaces):
+		obj = FakeObject(self, path, interfaces)
+		self.objects[path] = obj
+		self.InterfacesAdded(dbus.ObjectPath(path), self.managed(obj))
+		return obj
+
+	def remove(self, path):
+		obj = self.objects.pop(path)
+		self.InterfacesRemoved(dbus.ObjectPath(path), dbus.Array(list(obj.interfaces), signature='s'))
+		obj.remove_from_connection()
+
+	def remove_drive(self, drive_path):
+		for path, obj in list(self.objects.items()):
+			if BLOCK in obj.interfaces and obj.interfaces[BLOCK]['Drive'] == drive_path:
+				self.remove(path)
+		self.remove(drive_path)
+
+	def managed(self, obj):
+		return dbus.Dictionary({i: dbus.Dictionary(p, signature='sv') for i, p in obj.interfaces.items()},
+							   signature='sa{sv}')
+
+	def blocks(self):
+		return [obj for obj in self.objects.values() if FILESYSTEM in obj.interfaces]
+
+	@dbus.service.method(OBJECT_MANAGER, out_signature='a{oa{sa{sv}}}')
+	def GetManagedObjects(self):
+		return dbus.Dictionary({dbus.ObjectPath(p): self.managed(o) for p, o in self.objects.items()},
+							   signature='oa{sa{sv}}')
+
+	@dbus.service.signal(OBJECT_MANAGER, signature='oa{sa{sv}}')
+	def InterfacesAdded(self, path, interfaces):
+		pass
+
+	@dbus.service.signal(OBJECT_MANAGER, signature='oas')
+	def InterfacesRemoved(self, path, interfaces):
+		pass
+
+	@dbus.service.method(TEST, in_signature='uss')
+	def Hotplug(self, count, bus, fstype):
+		for i in range(count):
+			n = self.next_id
+			self.next_id += 1
+			drive = '%s/drives/fake_%d' % (ROOT, n)
+			self.add(drive, {DRIVE: {
+				'Optical': dbus.Boolean(False),
+				'Removable': dbus.Boolean(True),
+				'MediaRemovable': dbus.Boolean(False),
+				'MediaAvailable': dbus.Boolean(True),
+				'OpticalNumAudioTracks': dbus.UInt32(0),
+				'Media': dbus.String(''),
+				'ConnectionBus': dbus.String(bus),
+				'Ejectable': dbus.Boolean(False),
+				'CanPowerOff': dbus.Boolean(True),
+			}})
+			# Block, filesystem and probed IdUsage arrive in one signal
+			self.add('%s/block_devices/fake%d' % (ROOT, n), {
+				BLOCK: {
+					'Device': bytestring('/dev/x%d' % n),
+					'Drive': dbus.ObjectPath(drive),
+					'HintSystem': dbus.Boolean(False),
+					'HintIgnore': dbus.Boolean(False),
+					'HintAuto': dbus.Boolean(True),
+					'IdUsage': dbus.String('filesystem'),
+					'IdType': dbus.String(fstype),
+					'IdLabel': dbus.String('FAKE%d' % n),
+					'IdUUID': dbus.String('0000-%04d' % n),
+				},
+				FILESYSTEM: {
+					'MountPoints': bytestring_list([]),
+				},
+			})
+
+	@dbus.service.method(TEST, in_signature='u')
+	def Storm(self, rounds):
+		for r in range(rounds):
+			for obj in self.blocks():
+				obj.Mount({})
+			for obj in self.blocks():
+				obj.Unmount({})
+
+	@dbus.service.method(TEST)
+	def MountAll(self):
+		for obj in self.blocks():
+			if not obj.mounted():
+				obj.Mount({})
+
+	@dbus.service.method(TEST)
+	def RemoveAll(self):
+		for path, obj in list(self.objects.items()):
+			if DRIVE in obj.interfaces:
+				self.remove_drive(path)
+
+	@dbus.service.method(TEST, out_signature='u')
+	def Mounted(self):
+		return dbus.UInt32(sum(1 for obj in self.blocks() if obj.mounted()))
+
+	@dbus.service.method(TEST, in_signature='s', out_signature='s')
+	def LastOptions(self, device):
+		for obj in self.blocks():
+			if bytes(obj.interfaces[BLOCK]['Device'][:-1]).decode() == device:
+				return obj.last_options
+		return ''
+
+
+def main():
+	dbus.mainloop.glib.DBusGMainLoop(set_as_default=True)
+	bus = dbus.SystemBus()
+	fake = FakeUDisks(dbus.service.BusName(BUS_NAME, bus))
+	if len(sys.argv) == 4:
+		fake.Hotplug(int(sys.argv[1]), sys.argv[2], sys.argv[3])
+
+	print('ready', flush=True)
+	GLib.MainLoop().run()
+
+
+if __name__ == '__main__':
+	sys.exit(main())
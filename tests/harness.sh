@@ -0,0 +1,168 @@
+# harness.sh - run wmvolman against fake-udisks.py, sourced by tests
+#
+# Everything runs on a private bus and a private X server, in a
+# temporary HOME that is removed on exit.  Tests are skipped (exit 77)
+# when a tool is missing, so "make check" works on any box.
+
+srcdir=${srcdir:-.}
+top_builddir=${top_builddir:-..}
+WMVOLMAN=${WMVOLMAN:-$top_builddir/src/wmvolman}
+
+skip()
+{
+	echo "SKIP: $*"
+	exit 77
+}
+
+fail()
+{
+	echo "FAIL: $*"
+	for log in "$tmpdir"/*.log; do
+		[ -s "$log" ] && { echo "--- $log"; tail -n 20 "$log"; }
+	done
+	exit 1
+}
+
+for tool in dbus-daemon dbus-send Xvfb python3; do
+	command -v $tool >/dev/null 2>&1 || skip "$tool not found"
+done
+python3 -c 'import dbus, gi' 2>/dev/null || skip "python3 dbus and gi modules not found"
+[ -x "$WMVOLMAN" ] || skip "$WMVOLMAN not built"
+
+abs_top_srcdir=$(cd "$srcdir/.." && pwd)
+tmpdir=$(mktemp -d "${TMPDIR:-/tmp}/wmvolman-test.XXXXXX")
+pids=""
+
+cleanup()
+{
+	for pid in $pids; do
+		kill $pid 2>/dev/null
+	done
+	rm -rf "$tmpdir"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# Wait up to 10 s for a command to succeed
+wait_for()
+{
+	i=0
+	until "$@"; do
+		i=$((i + 1))
+		[ $i -lt 100 ] || return 1
+		sleep 0.1
+	done
+}
+
+start_bus()
+{
+	out=$(dbus-daemon --config-file="$srcdir/system-bus.conf" --fork --print-address=1 --print-pid=1) ||
+		fail "can not start dbus-daemon"
+	DBUS_SYSTEM_BUS_ADDRESS=$(echo "$out" | sed -n 1p)
+	pids="$pids $(echo "$out" | sed -n 2p)"
+	export DBUS_SYSTEM_BUS_ADDRESS
+}
+
+start_x()
+{
+	Xvfb -displayfd 5 -screen 0 640x480x24 -nolisten tcp 5>"$tmpdir/display" >"$tmpdir/xvfb.log" 2>&1 &
+	pids="$pids $!"
+	wait_for test -s "$tmpdir/display" || fail "can not start Xvfb"
+	DISPLAY=:$(cat "$tmpdir/display")
+	export DISPLAY
+}
+
+has_owner()
+{
+	dbus-send --bus="$DBUS_SYSTEM_BUS_ADDRESS" --print-reply --dest=org.freedesktop.DBus \
+		/org/freedesktop/DBus org.freedesktop.DBus.NameHasOwner string:org.freedesktop.UDisks2 |
+		grep -q 'boolean true'
+}
+
+# start_fake [COUNT BUS TYPE]: drives present from the start
+start_fake()
+{
+	python3 "$srcdir/fake-udisks.py" "$@" >"$tmpdir/fake.log" 2>&1 &
+	fake_pid=$!
+	pids="$pids $fake_pid"
+	wait_for has_owner || fail "fake-udisks.py did not start"
+}
+
+stop_fake()
+{
+	kill $fake_pid 2>/dev/null
+	wait $fake_pid 2>/dev/null
+}
+
+# fake METHOD [ARG...], arguments in dbus-send syntax
+fake()
+{
+	method=$1
+	shift
+	dbus-send --bus="$DBUS_SYSTEM_BUS_ADDRESS" --print-reply --dest=org.freedesktop.UDisks2 \
+		/org/freedesktop/UDisks2 org.wmvolman.Test.$method "$@" >"$tmpdir/reply" ||
+		fail "fake $method failed"
+	sed -n 's/^  *[a-z0-9]* \(.*\)$/\1/p' "$tmpdir/reply" | sed 's/^"\(.*\)"$/\1/'
+}
+
+# Extra arguments go to wmvolman, config is read from $tmpdir/.wmvolman
+start_wmvolman()
+{
+	mkdir -p "$tmpdir/.wmvolman"
+	[ -e "$tmpdir/.wmvolman/default" ] || ln -s "$abs_top_srcdir/icons" "$tmpdir/.wmvolman/default"
+	HOME="$tmpdir" XDG_CACHE_HOME="$tmpdir/cache" G_MESSAGES_DEBUG=all \
+		"$WMVOLMAN" -d "$DISPLAY" -S "$tmpdir/stats" "$@" >"$tmpdir/wmvolman.log" 2>&1 &
+	wmvolman_pid=$!
+	pids="$pids $wmvolman_pid"
+	sleep 1
+	alive || fail "wmvolman did not start"
+}
+
+stop_wmvolman()
+{
+	kill $wmvolman_pid 2>/dev/null
+	wait $wmvolman_pid 2>/dev/null
+}
+
+alive()
+{
+	kill -0 $wmvolman_pid 2>/dev/null
+}
+
+# Fresh statistics dump in $tmpdir/stats
+dump_stats()
+{
+	: >"$tmpdir/stats"
+	kill -USR1 $wmvolman_pid || fail "wmvolman died"
+	# Last line of the dump
+	wait_for grep -q '^  hotplug to mounted' "$tmpdir/stats" || fail "no statistics dump"
+}
+
+# counter NAME: counter value from last dump
+counter()
+{
+	sed -n "s/^  $1  *\([0-9][0-9]*\)\$/\1/p" "$tmpdir/stats"
+}
+
+# hist NAME FIELD: histogram field (samples, avg, p50, p90, p99, max), empty without samples
+hist()
+{
+	case $2 in
+	samples)
+		sed -n "s/^  $1  *\([0-9][0-9]*\) samples.*/\1/p" "$tmpdir/stats" ;;
+	*)
+		sed -n "s/^  $1  .*[ ,]$2 \([0-9][0-9]*\).*/\1/p" "$tmpdir/stats" ;;
+	esac
+}
+
+# CPU time of wmvolman in ms
+cpu_ms()
+{
+	awk -v tck=$(getconf CLK_TCK) '{ print int(($14 + $15) * 1000 / tck) }' /proc/$wmvolman_pid/stat
+}
+
+# Peak resident set size of wmvolman in kB
+rss_kb()
+{
+	sed -n 's/^VmHWM: *\([0-9]*\) kB/\1/p' /proc/$wmvolman_pid/status
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# test-automount.sh - hotplugged volumes are mounted by the rules
+#
+# A volume present at startup must stay unmounted.  Volumes added later
+# arrive as new objects, like a real udisksd sends them, and only the
+# ones matching a rule get mounted, with the matching profile options.
+
+. "${srcdir:-.}/harness.sh"
+
+mkdir -p "$tmpdir/.wmvolman"
+cat >"$tmpdir/.wmvolman/wmvolman.conf" <<CONF
+[automount usb-sticks]
+bus=usb
+type=vfat
+
+[profile bulk]
+bus=usb
+options=flush
+CONF
+
+mounted()
+{
+	[ "$(fake Mounted)" -eq $1 ]
+}
+
+start_bus
+start_x
+start_fake
+
+fake Hotplug uint32:1 string:usb string:vfat
+start_wmvolman
+sleep 1
+mounted 0 || fail "volume present at startup was automounted"
+
+fake Hotplug uint32:1 string:usb string:vfat
+wait_for mounted 1 || fail "hotplugged volume was not automounted"
+[ "$(fake LastOptions string:/dev/x1)" = flush ] || fail "profile options were not passed"
+
+# No rule for ext4
+fake Hotplug uint32:1 string:usb string:ext4
+sleep 1
+mounted 1 || fail "volume without a matching rule was automounted"
+
+dump_stats
+echo "hotplug to mounted: $(hist 'hotplug to mounted' samples) samples, p50 $(hist 'hotplug to mounted' p50) us"
+[ "$(hist 'hotplug to mounted' samples)" = 1 ] || fail "automount was not recorded"
+
+exit 0
@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# test-idle.sh - wmvolman must not wake up while nothing changes
+#
+# Counters are compared across a quiet period: timer wakeups must not
+# move at all, main loop iterations only by the wakeup for the
+# statistics dump itself.  Checked with no volumes and with a volume
+# whose title fits, then a long, scrolling title makes sure the
+# counters do move when there is something to do.
+
+. "${srcdir:-.}/harness.sh"
+
+quiet=5
+
+# idle_delta COUNTER: change of counter over the quiet period
+idle_delta()
+{
+	dump_stats
+	before=$(counter "$1")
+	sleep $quiet
+	dump_stats
+	echo $(($(counter "$1") - before))
+}
+
+check_idle()
+{
+	wakeups=$(idle_delta "timer wakeups")
+	iterations=$(idle_delta "main loop iterations")
+	echo "$1: $wakeups timer wakeups, $iterations main loop iterations in $quiet s"
+	[ $wakeups -eq 0 ] || fail "$1: timer woke up $wakeups times"
+	[ $iterations -le 2 ] || fail "$1: main loop woke up $iterations times"
+}
+
+start_bus
+start_x
+start_fake
+start_wmvolman
+
+sleep 1
+check_idle "no volumes"
+
+# "/dev/x0" fits into the dock
+fake Hotplug uint32:1 string:usb string:vfat
+sleep 1
+check_idle "short title"
+
+# Mount point does not fit and scrolls
+fake MountAll
+sleep 1
+wakeups=$(idle_delta "timer wakeups")
+echo "long title: $wakeups timer wakeups in $quiet s"
+[ $wakeups -gt 0 ] || fail "long title did not scroll"
+
+exit 0
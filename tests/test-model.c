@@ -0,0 +1,332 @@
+/*
+ * test-model.c - Window Maker Volume Manager, volume list tests
+ *
+ * Copyright (C) 2026  wmVolMan contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <string.h>
+#ifdef HAVE_MALLINFO2
+# include <malloc.h>
+#endif
+#include <glib.h>
+
+#include "model.h"
+#include "ui.h"
+
+/*
+ * Observer that checks invariants on every notification: current is
+ * NULL or a live volume in the list, and a volume being freed is never
+ * current.
+ */
+static guint changes = 0, list_changes = 0, frees = 0;
+static gboolean allow_select = TRUE;
+
+static gboolean is_listed(WMVMVolume *vol)
+{
+	WMVMVolume *v;
+
+	for (v = wmvm_model_first(); v != NULL; v = wmvm_model_next(v))
+		if (v == vol)
+			return TRUE;
+
+	return FALSE;
+}
+
+static void check_current(void)
+{
+	WMVMVolume *current = wmvm_model_current();
+
+	if (current == NULL) {
+		/* Only an empty list, or one being filled, has no selection */
+		g_assert(wmvm_model_in_update() || wmvm_model_first() == NULL);
+		return;
+	}
+
+	g_assert(wmvm_is_managed_volume(current->udi));
+	g_assert(is_listed(current));
+}
+
+static void test_changed(WMVMVolume *vol, guint what)
+{
+	changes++;
+	if (what & WMVM_CHANGED_LIST)
+		list_changes++;
+
+	if (vol != NULL)
+		g_assert(wmvm_is_managed_volume(vol->udi));
+	if (wmvm_model_current() != NULL)
+		g_assert(wmvm_is_managed_volume(wmvm_model_current()->udi));
+}
+
+static void test_freeing(WMVMVolume *vol)
+{
+	frees++;
+	g_assert(vol != wmvm_model_current());
+}
+
+static gboolean test_may_select(void)
+{
+	return allow_select;
+}
+
+static const WMVMModelObserver test_observer = {
+	test_changed,
+	test_freeing,
+	test_may_select
+};
+
+static void reset(void)
+{
+	wmvm_remove_all_volumes();
+	g_assert(wmvm_model_current() == NULL);
+	g_assert(wmvm_model_first() == NULL);
+
+	changes = list_changes = frees = 0;
+	allow_select = TRUE;
+}
+
+static void add(int n)
+{
+	char udi[64], device[64];
+
+	g_snprintf(udi, sizeof(udi), "/org/freedesktop/UDisks2/block_devices/test%d", n);
+	g_snprintf(device, sizeof(device), "/dev/test%06d", n);
+	wmvm_update_volume(udi, device, WMVM_ICON_HARDDISK, TRUE);
+}
+
+static void del(int n)
+{
+	char udi[64];
+
+	g_snprintf(udi, sizeof(udi), "/org/freedesktop/UDisks2/block_devices/test%d", n);
+	wmvm_remove_volume(udi);
+}
+
+static const char *device_of(WMVMVolume *vol)
+{
+	return vol ? vol->device : NULL;
+}
+
+static void test_select(void)
+{
+	reset();
+
+	add(1);
+	g_assert_cmpstr(device_of(wmvm_model_current()), ==, "/dev/test000001");
+
+	/* New volumes become current only when observer allows */
+	add(2);
+	g_assert_cmpstr(device_of(wmvm_model_current()), ==, "/dev/test000002");
+	allow_select = FALSE;
+	add(3);
+	g_assert_cmpstr(device_of(wmvm_model_current()), ==, "/dev/test000002");
+	check_current();
+}
+
+static void test_remove_current(void)
+{
+	reset();
+
+	add(1);
+	add(2);
+	add(3);
+
+	/* Previous volume takes over, or next one at the head */
+	wmvm_model_set_current(wmvm_model_next(wmvm_model_first()));
+	del(2);
+	g_assert_cmpstr(device_of(wmvm_model_current()), ==, "/dev/test000001");
+	del(1);
+	g_assert_cmpstr(device_of(wmvm_model_current()), ==, "/dev/test000003");
+	del(3);
+	g_assert(wmvm_model_current() == NULL);
+	g_assert_cmpuint(frees, ==, 3);
+}
+
+static void test_batch(void)
+{
+	guint before;
+
+	reset();
+
+	wmvm_begin_update();
+	wmvm_begin_update();
+	add(3);
+	add(1);
+	add(2);
+	wmvm_commit_update();
+
+	/* Nothing is selected or reported until outermost commit */
+	g_assert(wmvm_model_in_update());
+	g_assert(wmvm_model_current() == NULL);
+	before = changes;
+	wmvm_commit_update();
+	g_assert(!wmvm_model_in_update());
+	g_assert_cmpuint(changes, >, before);
+
+	/* Sorted by device, head selected */
+	g_assert_cmpstr(device_of(wmvm_model_first()), ==, "/dev/test000001");
+	g_assert_cmpstr(device_of(wmvm_model_next(wmvm_model_first())), ==, "/dev/test000002");
+	g_assert(wmvm_model_current() == wmvm_model_first());
+	check_current();
+}
+
+static void test_stale(void)
+{
+	reset();
+
+	add(1);
+	add(2);
+	add(3);
+	wmvm_model_set_current(wmvm_model_first());
+
+	wmvm_begin_update();
+	wmvm_mark_volumes_stale();
+	add(2);
+	wmvm_remove_stale_volumes();
+	wmvm_commit_update();
+
+	g_assert(!wmvm_is_managed_volume("/org/freedesktop/UDisks2/block_devices/test1"));
+	g_assert(wmvm_is_managed_volume("/org/freedesktop/UDisks2/block_devices/test2"));
+	g_assert(!wmvm_is_managed_volume("/org/freedesktop/UDisks2/block_devices/test3"));
+	g_assert_cmpstr(device_of(wmvm_model_current()), ==, "/dev/test000002");
+	check_current();
+}
+
+/* Random operations, current must stay live after each one */
+static void test_random(void)
+{
+	int i;
+
+	reset();
+
+	for (i = 0; i < 20000; i++) {
+		int n = g_test_rand_int_range(0, 64);
+
+		switch (g_test_rand_int_range(0, 6)) {
+		case 0:
+		case 1:
+			add(n);
+			break;
+		case 2:
+			del(n);
+			break;
+		case 3:
+			allow_select = !allow_select;
+			break;
+		case 4:
+			wmvm_begin_update();
+			add(n);
+			del(g_test_rand_int_range(0, 64));
+			wmvm_commit_update();
+			break;
+		case 5:
+			if (g_test_rand_bit())
+				wmvm_model_set_current(wmvm_model_prev(wmvm_model_current()) ?
+									   wmvm_model_prev(wmvm_model_current()) : wmvm_model_current());
+			else if (wmvm_model_next(wmvm_model_current()))
+				wmvm_model_set_current(wmvm_model_next(wmvm_model_current()));
+			break;
+		}
+
+		check_current();
+	}
+}
+
+static gsize heap_used(void)
+{
+#ifdef HAVE_MALLINFO2
+	return mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+}
+
+/* Insert, lookup and remove throughput, and memory per volume, with -m perf */
+static void test_bench(void)
+{
+	static const int sizes[] = { 10, 1000, 100000 };
+	int s;
+
+	for (s = 0; s < G_N_ELEMENTS(sizes); s++) {
+		int i, n = sizes[s], rounds = MAX(1, 100000 / n);
+		gdouble insert = 0, lookup = 0, removal = 0;
+		gsize heap = 0;
+		GTimer *timer = g_timer_new();
+		char udi[64];
+		int r;
+
+		for (r = 0; r < rounds; r++) {
+			gsize before;
+
+			reset();
+
+			before = heap_used();
+			g_timer_start(timer);
+			wmvm_begin_update();
+			for (i = 0; i < n; i++)
+				add(i);
+			wmvm_commit_update();
+			insert += g_timer_elapsed(timer, NULL);
+			if (heap_used() > before)
+				heap += heap_used() - before;
+
+			g_timer_start(timer);
+			for (i = 0; i < n; i++) {
+				g_snprintf(udi, sizeof(udi), "/org/freedesktop/UDisks2/block_devices/test%d", i);
+				g_assert(wmvm_is_managed_volume(udi));
+			}
+			lookup += g_timer_elapsed(timer, NULL);
+
+			g_timer_start(timer);
+			for (i = 0; i < n; i++)
+				del(i);
+			removal += g_timer_elapsed(timer, NULL);
+
+			g_assert(wmvm_model_current() == NULL);
+		}
+
+		g_test_maximized_result(n * rounds / insert, "%d volumes: insert %.0f/s", n, n * rounds / insert);
+		g_test_maximized_result(n * rounds / lookup, "%d volumes: lookup %.0f/s", n, n * rounds / lookup);
+		g_test_maximized_result(n * rounds / removal, "%d volumes: remove %.0f/s", n, n * rounds / removal);
+		g_test_minimized_result(heap / ((gdouble) n * rounds), "%d volumes: %" G_GSIZE_FORMAT " bytes per volume",
+								n, heap / ((gsize) n * rounds));
+
+		g_timer_destroy(timer);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	wmvm_model_set_observer(&test_observer);
+
+	g_test_add_func("/model/select", test_select);
+	g_test_add_func("/model/remove-current", test_remove_current);
+	g_test_add_func("/model/batch", test_batch);
+	g_test_add_func("/model/stale", test_stale);
+	g_test_add_func("/model/random", test_random);
+	if (g_test_perf())
+		g_test_add_func("/model/bench", test_bench);
+
+	return g_test_run();
+}
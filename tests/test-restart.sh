@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# test-restart.sh - volumes survive a quick udisksd restart
+#
+# The fake is killed and started again within the grace period, with
+# the same drives.  No volume may be removed and added back, or the
+# dock would flicker on every udisksd restart.  A fake that stays away
+# longer than the grace period takes the volumes with it.
+
+. "${srcdir:-.}/harness.sh"
+
+start_bus
+start_x
+start_fake 2 usb vfat
+start_wmvolman
+sleep 1
+
+dump_stats
+added=$(counter "volumes added")
+[ "$added" -eq 2 ] || fail "expected 2 volumes, got $added"
+
+stop_fake
+start_fake 2 usb vfat
+sleep 1
+
+dump_stats
+removed=$(counter "volumes removed")
+echo "quick restart: $removed volumes removed, $(counter 'volumes added') added"
+[ "$removed" -eq 0 ] || fail "quick restart removed $removed volumes"
+[ "$(counter 'volumes added')" -eq 2 ] || fail "quick restart added volumes again"
+
+stop_fake
+sleep 3
+dump_stats
+[ "$(counter 'volumes removed')" -eq 2 ] || fail "volumes outlived udisksd"
+
+exit 0